@@ -0,0 +1,42 @@
+#include "benches.h"
+
+#include <QCoreApplication>
+#include <QLoggingCategory>
+#include <QTextStream>
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+
+    // Per-download log lines would dominate the run time
+    QLoggingCategory::setFilterRules("esomm.core.info=false");
+
+    QStringList arguments = app.arguments();
+    const QString mode = arguments.value(1);
+    if (arguments.size() > 1) arguments.removeAt(1);
+
+    if (mode == "download") {
+        return runDownloadBench(arguments);
+    }
+    if (mode == "catalog") {
+        return runCatalogBench(arguments);
+    }
+    if (mode == "catalog-memory") {
+        return runCatalogMemoryBench(arguments);
+    }
+    if (mode == "store") {
+        return runStoreBench(arguments);
+    }
+    if (mode == "entry-paths") {
+        return runEntryPathCheck(arguments);
+    }
+
+    QTextStream(stderr) << "Usage: esomm_bench <mode> [options]\n"
+        << "Modes:\n"
+        << "  download        HttpClient against a local mock server\n"
+        << "  catalog         Catalog decoding, serial and parallel\n"
+        << "  catalog-memory  String memory of the decoded catalog, with and without interning\n"
+        << "  store           Catalog filters and sorts, QList<ModInfo> against CatalogStore\n"
+        << "  entry-paths     Check that unsafe archive entry names are refused\n"
+        << "Run a mode with --help for its options.\n";
+    return 1;
+}
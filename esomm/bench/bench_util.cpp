@@ -0,0 +1,153 @@
+#include "bench_util.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QRandomGenerator>
+#include <QFile>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#endif
+
+QByteArray syntheticCatalog(int entries, quint32 seed) {
+    QRandomGenerator random(seed);
+
+    // A few hundred authors and a handful of API versions, as on the live site
+    const QStringList apiVersions = { "101041", "101042", "101043", "101044", "101045" };
+    const QStringList gameVersions = { "9.3.0", "10.0.0", "10.1.0", "10.2.0" };
+    const QDateTime epoch = QDateTime::fromString("2014-04-04T00:00:00Z", Qt::ISODate);
+
+    QJsonArray catalog;
+    for (int i = 0; i < entries; i++) {
+        const QString id = QString::number(1000 + i);
+        const QString title = QString("Synthetic Addon %1").arg(i);
+        const bool library = random.bounded(8) == 0;
+
+        QJsonArray addons;
+        const int addonCount = 1 + (random.bounded(10) == 0 ? random.bounded(4) : 0);
+        for (int a = 0; a < addonCount; a++) {
+            QJsonArray required;
+            for (int d = random.bounded(4); d > 0; d--) {
+                required.append(QString("LibSynthetic%1").arg(random.bounded(200)));
+            }
+
+            QJsonObject addon;
+            addon["path"] = a == 0 ? QString("SyntheticAddon%1").arg(i) : QString("SyntheticAddon%1_%2").arg(i).arg(a);
+            addon["addOnVersion"] = QString::number(random.bounded(1, 400));
+            addon["apiVersion"] = apiVersions[random.bounded(apiVersions.size())];
+            addon["library"] = library;
+            addon["requiredDependencies"] = required;
+            addon["optionalDependencies"] = QJsonArray();
+            addons.append(addon);
+        }
+
+        QJsonObject mod;
+        mod["id"] = id;
+        mod["categoryId"] = QString::number(random.bounded(1, 60));
+        mod["version"] = QString("%1.%2.%3").arg(random.bounded(10)).arg(random.bounded(20)).arg(random.bounded(50));
+        mod["lastUpdate"] = epoch.addSecs(random.bounded(360 * 24 * 3600) * 10LL).toString(Qt::ISODate);
+        mod["title"] = title;
+        mod["author"] = QString("Author%1").arg(random.bounded(400));
+        mod["fileInfoUri"] = QString("https://www.esoui.com/downloads/info%1.html").arg(id);
+        mod["downloads"] = int(random.bounded(2000000));
+        mod["downloadsMonthly"] = int(random.bounded(50000));
+        mod["favorites"] = int(random.bounded(5000));
+        mod["checksum"] = QString::fromLatin1(QCryptographicHash::hash(title.toUtf8(), QCryptographicHash::Md5).toHex());
+        mod["library"] = library;
+        if (random.bounded(3) == 0) {
+            mod["donationUri"] = QString("https://www.esoui.com/downloads/donate.php?id=%1").arg(id);
+        }
+        mod["downloadUri"] = QString("https://cdn.esoui.com/downloads/file%1/synthetic.zip").arg(id);
+        mod["gameVersions"] = QJsonArray::fromStringList(gameVersions.mid(random.bounded(gameVersions.size())));
+        mod["addons"] = addons;
+        catalog.append(mod);
+    }
+
+    return QJsonDocument(catalog).toJson(QJsonDocument::Compact);
+}
+
+QString benchCatalogPath(const QCommandLineParser& parser, const QTemporaryDir& dir) {
+    if (!parser.value("file").isEmpty()) {
+        return parser.value("file");
+    }
+
+    const QString filePath = dir.path() + "/filelist.json";
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        QTextStream(stderr) << "Cannot write " << filePath << "\n";
+        return QString();
+    }
+    file.write(syntheticCatalog(qMax(1, parser.value("entries").toInt()), parser.value("seed").toUInt()));
+    return filePath;
+}
+
+QByteArray syntheticArchive(qint64 size, quint32 seed) {
+    QByteArray data(size, Qt::Uninitialized);
+    QRandomGenerator random(seed);
+    const qint64 words = size / sizeof(quint32);
+    random.fillRange(reinterpret_cast<quint32*>(data.data()), words);
+    for (qint64 i = words * sizeof(quint32); i < size; i++) {
+        data[i] = char(random.bounded(256));
+    }
+    return data;
+}
+
+ProcessStats sampleProcess() {
+    ProcessStats stats;
+
+#if defined(Q_OS_LINUX)
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        for (const QByteArray& line : status.readAll().split('\n')) {
+            if (line.startsWith("VmHWM:")) {
+                stats.peakRssBytes = line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+            } else if (line.startsWith("Threads:")) {
+                stats.threads = line.mid(8).trimmed().toInt();
+            }
+        }
+    }
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        stats.peakRssBytes = qint64(counters.PeakWorkingSetSize);
+    }
+
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE) {
+        THREADENTRY32 entry;
+        entry.dwSize = sizeof(entry);
+        stats.threads = 0;
+        for (BOOL ok = Thread32First(snapshot, &entry); ok; ok = Thread32Next(snapshot, &entry)) {
+            if (entry.th32OwnerProcessID == GetCurrentProcessId()) {
+                stats.threads++;
+            }
+        }
+        CloseHandle(snapshot);
+    }
+#endif
+
+    return stats;
+}
+
+qint64 percentile(QList<qint64> values, double p) {
+    if (values.isEmpty()) return 0;
+
+    std::sort(values.begin(), values.end());
+    const qsizetype rank = qsizetype(std::ceil(p * values.size()));
+    return values[qBound<qsizetype>(0, rank - 1, values.size() - 1)];
+}
+
+double toMiB(qint64 bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QCommandLineParser;
+class QTemporaryDir;
+
+// Synthetic mmoui filelist with the same shape and field mix as the live catalog
+QByteArray syntheticCatalog(int entries, quint32 seed = 1);
+
+// Catalog a mode runs on: --file when given, else syntheticCatalog(--entries, --seed) written into
+// dir. Prints why and returns an empty path when the synthetic one cannot be written
+QString benchCatalogPath(const QCommandLineParser& parser, const QTemporaryDir& dir);
+
+// Incompressible payload standing in for a mod archive
+QByteArray syntheticArchive(qint64 size, quint32 seed = 1);
+
+struct ProcessStats {
+    qint64 peakRssBytes = -1; // -1 where the platform gives no answer
+    int threads = -1;
+};
+
+ProcessStats sampleProcess();
+
+// Nearest-rank percentile, p in [0, 1]
+qint64 percentile(QList<qint64> values, double p);
+
+double toMiB(qint64 bytes);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <QStringList>
+
+// Each mode takes the command line with the mode name removed and returns the exit code
+int runDownloadBench(const QStringList& arguments);
+int runCatalogBench(const QStringList& arguments);
+int runCatalogMemoryBench(const QStringList& arguments);
+int runStoreBench(const QStringList& arguments);
+int runEntryPathCheck(const QStringList& arguments);
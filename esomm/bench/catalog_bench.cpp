@@ -0,0 +1,205 @@
+#include "benches.h"
+#include "bench_util.h"
+#include "catalog_parser.h"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+// Median wall time of runs calls to parse, which returns the number of entries it decoded
+static qint64 timeRuns(int runs, int* entries, const std::function<int()>& parse) {
+    QList<qint64> times;
+    for (int i = 0; i < runs; i++) {
+        QElapsedTimer clock;
+        clock.start();
+        *entries = parse();
+        times.append(clock.nsecsElapsed() / 1000);
+    }
+    return percentile(times, 0.5);
+}
+
+int runCatalogBench(const QStringList& arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Decodes the mod catalog serially and across a range of thread counts.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "file", "Catalog to decode, e.g. a saved filelist.json. A synthetic one is generated otherwise.", "path" },
+        { "entries", "Entries in the synthetic catalog.", "count", "10000" },
+        { "threads", "Comma separated thread counts, defaults to powers of two up to the core count.", "list" },
+        { "runs", "Runs per configuration, the median is reported.", "count", "5" },
+        { "seed", "Seed for the synthetic catalog.", "number", "1" },
+    });
+    parser.process(arguments);
+
+    const int runs = qMax(1, parser.value("runs").toInt());
+
+    QTemporaryDir dir;
+    const QString filePath = benchCatalogPath(parser, dir);
+    if (filePath.isEmpty()) return 1;
+
+    QList<int> threadCounts;
+    for (const QString& count : parser.value("threads").split(',', Qt::SkipEmptyParts)) {
+        if (count.toInt() > 0) threadCounts.append(count.toInt());
+    }
+    if (threadCounts.isEmpty()) {
+        for (int count = 1; count < QThread::idealThreadCount(); count *= 2) {
+            threadCounts.append(count);
+        }
+        threadCounts.append(QThread::idealThreadCount());
+    }
+
+    QTextStream out(stdout);
+    out << "catalog=" << filePath << " size=" << QString::number(toMiB(QFileInfo(filePath).size()), 'f', 1)
+        << "MiB runs=" << runs << " cores=" << QThread::idealThreadCount() << Qt::endl;
+    out << "mode              threads   median_ms   entries   entries/s  speedup" << Qt::endl;
+
+    const auto report = [&out](const QString& mode, int threads, qint64 micros, int entries, qint64 baseline) {
+        const double ms = micros / 1000.0;
+        out << qSetFieldWidth(16) << Qt::left << mode << qSetFieldWidth(0) << Qt::right << "  "
+            << qSetFieldWidth(7) << threads << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(10) << QString::number(ms, 'f', 2) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(8) << entries << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(10) << qint64(entries / qMax(ms, 0.001) * 1000) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(7) << QString::number(double(baseline) / qMax<qint64>(1, micros), 'f', 2) << "x"
+            << qSetFieldWidth(0) << Qt::endl;
+    };
+
+    int exitCode = 0;
+    int entries = 0;
+
+    // Reference point: what a DOM parse alone costs, before any ModInfo is built
+    const qint64 domMicros = timeRuns(runs, &entries, [&filePath]() {
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly)) return 0;
+        return int(QJsonDocument::fromJson(file.readAll()).array().size());
+    });
+    report("json-dom", 1, domMicros, entries, domMicros);
+
+    const qint64 streamMicros = timeRuns(runs, &entries, [&filePath, &exitCode]() {
+        int count = 0;
+        QString error;
+        if (!CatalogParser::parseFile(filePath, [&count](ModInfo&&) { count++; }, &error)) exitCode = 2;
+        return count;
+    });
+    report("stream", 1, streamMicros, entries, streamMicros);
+
+    for (int threads : threadCounts) {
+        QThreadPool pool;
+        pool.setMaxThreadCount(threads);
+
+        const qint64 micros = timeRuns(runs, &entries, [&filePath, &pool, &exitCode]() {
+            QList<ModInfo> mods;
+            QString error;
+            CatalogParseOptions options;
+            options.pool = &pool;
+            if (!CatalogParser::parseFileParallel(filePath, &mods, &error, options)) exitCode = 2;
+            return int(mods.size());
+        });
+        report("parallel", threads, micros, entries, streamMicros);
+    }
+
+    return exitCode;
+}
+
+// Heap held by the catalog's strings: every distinct buffer once, with its array header
+struct StringFootprint {
+    qint64 strings = 0;
+    qint64 buffers = 0;
+    qint64 bytes = 0;
+};
+
+static StringFootprint measureStrings(const QList<ModInfo>& mods) {
+    StringFootprint footprint;
+    QSet<const void*> seen;
+
+    const auto add = [&](const QString& value) {
+        footprint.strings++;
+        if (value.capacity() == 0 || seen.contains(value.constData())) return;
+        seen.insert(value.constData());
+        footprint.buffers++;
+        footprint.bytes += qint64(sizeof(QArrayData)) + (value.capacity() + 1) * qint64(sizeof(QChar));
+    };
+    const auto addAll = [&](const QList<QString>& values) {
+        for (const QString& value : values) add(value);
+    };
+
+    for (const ModInfo& mod : mods) {
+        add(mod.id);
+        add(mod.categoryId);
+        add(mod.version);
+        add(mod.lastUpdate);
+        add(mod.title);
+        add(mod.author);
+        add(mod.fileInfoUri);
+        add(mod.checksum);
+        addAll(mod.gameVersions);
+        for (const Dependancies& addon : mod.addons) {
+            add(addon.path);
+            add(addon.addOnVersion);
+            add(addon.apiVersion);
+            addAll(addon.optionalDependencies);
+            addAll(addon.requiredDependencies);
+        }
+    }
+    return footprint;
+}
+
+int runCatalogMemoryBench(const QStringList& arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Reports the string memory of a decoded catalog with and without interning.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "file", "Catalog to decode, e.g. a saved filelist.json. A synthetic one is generated otherwise.", "path" },
+        { "entries", "Entries in the synthetic catalog.", "count", "10000" },
+        { "seed", "Seed for the synthetic catalog.", "number", "1" },
+    });
+    parser.process(arguments);
+
+    QTemporaryDir dir;
+    const QString filePath = benchCatalogPath(parser, dir);
+    if (filePath.isEmpty()) return 1;
+
+    QTextStream out(stdout);
+    out << "catalog=" << filePath << " size=" << QString::number(toMiB(QFileInfo(filePath).size()), 'f', 1) << "MiB" << Qt::endl;
+    out << "mode        entries   strings   buffers   string_MiB" << Qt::endl;
+
+    StringFootprint plain;
+    for (bool intern : { false, true }) {
+        QList<ModInfo> mods;
+        QString error;
+        StringPool strings;
+        CatalogParseOptions options;
+        options.internStrings = intern;
+        options.strings = &strings;
+        if (!CatalogParser::parseFileParallel(filePath, &mods, &error, options)) {
+            QTextStream(stderr) << "Failed to decode " << filePath << ": " << error << "\n";
+            return 2;
+        }
+
+        const StringFootprint footprint = measureStrings(mods);
+        if (!intern) plain = footprint;
+
+        out << qSetFieldWidth(10) << Qt::left << (intern ? "interned" : "plain") << qSetFieldWidth(0) << Qt::right << "  "
+            << qSetFieldWidth(7) << mods.size() << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(8) << footprint.strings << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(8) << footprint.buffers << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(11) << QString::number(toMiB(footprint.bytes), 'f', 2) << qSetFieldWidth(0) << Qt::endl;
+
+        if (intern) {
+            const StringPool::Stats stats = strings.stats();
+            out << "pool: " << stats.distinct << " distinct values, " << stats.hits << " of " << stats.lookups
+                << " lookups shared, " << QString::number(toMiB(plain.bytes - footprint.bytes), 'f', 2)
+                << " MiB saved (" << QString::number(100.0 * (plain.bytes - footprint.bytes) / qMax<qint64>(1, plain.bytes), 'f', 1)
+                << "% of string memory)" << Qt::endl;
+        }
+    }
+    return 0;
+}
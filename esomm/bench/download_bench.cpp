@@ -0,0 +1,216 @@
+#include "benches.h"
+#include "bench_util.h"
+#include "mock_server.h"
+#include "http_client.h"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+
+struct DownloadBenchConfig {
+    int files = 200;
+    qint64 fileSize = 1024 * 1024;
+    int catalogEntries = 10000;
+    bool adaptive = false;
+    int timeoutMs = 10 * 60 * 1000;
+};
+
+struct LevelResult {
+    qint64 catalogMs = -1;
+    qint64 wallMs = 0;
+    qint64 bytes = 0;
+    QList<qint64> latencies; // Enqueue to finish, queueing included
+    int failed = 0;
+    int maxThreads = -1;
+    int hostLimit = -1;
+    bool timedOut = false;
+};
+
+// Adds the batch, spins an event loop until every download settled and collects timings
+static LevelResult runLevel(HttpClient* client, MockServer* server, const DownloadBenchConfig& config, const QString& dir) {
+    LevelResult result;
+    QEventLoop loop;
+    QElapsedTimer clock;
+    QHash<QString, qint64> startedAt;
+    int pending = 0;
+
+    QTimer sampler;
+    QObject::connect(&sampler, &QTimer::timeout, &loop, [&result]() {
+        result.maxThreads = qMax(result.maxThreads, sampleProcess().threads);
+    });
+    sampler.start(50);
+
+    QTimer::singleShot(config.timeoutMs, &loop, [&]() {
+        result.timedOut = true;
+        loop.quit();
+    });
+
+    QObject::connect(client, &HttpClient::downloadFinished, &loop, [&](const QString& filePath) {
+        result.latencies.append(clock.elapsed() - startedAt.value(filePath));
+        result.bytes += QFileInfo(filePath).size();
+        if (--pending == 0) loop.quit();
+    });
+    QObject::connect(client, &HttpClient::downloadFailed, &loop, [&](const QString&, const QString&) {
+        result.failed++;
+        if (--pending == 0) loop.quit();
+    });
+    QObject::connect(client, &HttpClient::hostStatsChanged, &loop, [&result](const QString&, const HostStats& stats) {
+        result.hostLimit = stats.limit;
+    });
+
+    // The catalog goes first and alone, as on startup
+    const QString catalogPath = dir + "/filelist.json";
+    clock.start();
+    startedAt.insert(catalogPath, 0);
+    pending = 1;
+    client->addDownload(server->url("/filelist.json"), catalogPath, { false, DownloadPriority::Catalog, {} });
+    loop.exec();
+    result.catalogMs = result.latencies.value(0, -1);
+    result.latencies.clear();
+    result.bytes = 0;
+
+    if (!result.timedOut) {
+        pending = config.files;
+        clock.restart();
+        for (int i = 0; i < config.files; i++) {
+            const QString filePath = QString("%1/%2.zip").arg(dir).arg(i);
+            startedAt.insert(filePath, clock.elapsed());
+            client->addDownload(server->url(QString("/files/%1.zip").arg(i)), filePath, { false, DownloadPriority::Background, {} });
+        }
+        loop.exec();
+        result.wallMs = clock.elapsed();
+    }
+
+    QObject::disconnect(client, nullptr, &loop, nullptr);
+    return result;
+}
+
+int runDownloadBench(const QStringList& arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Downloads synthetic archives from a local mock server at several concurrency levels.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "files", "Archives per concurrency level.", "count", "200" },
+        { "size", "Archive size in bytes.", "bytes", QString::number(1024 * 1024) },
+        { "catalog", "Entries in the synthetic catalog.", "count", "10000" },
+        { "concurrency", "Comma separated concurrency levels.", "list", "1,4,8,16,32" },
+        { "adaptive", "Let the per-host limit adapt between 1 and the level instead of pinning it." },
+        { "latency", "Server delay before each response, in ms.", "ms", "20" },
+        { "bandwidth", "Per-connection bandwidth in bytes/s, 0 for unlimited.", "bytes", "0" },
+        { "chunk", "Bytes written per pacing tick.", "bytes", "16384" },
+        { "fail-rate", "Share of responses cut off halfway.", "ratio", "0" },
+        { "throttle-rate", "Share of requests answered with 429.", "ratio", "0" },
+        { "retry-after", "Retry-After sent with a 429, in seconds.", "seconds", "1" },
+        { "no-ranges", "Ignore Range requests, every retry starts over." },
+        { "seed", "Seed for the synthetic data and injected faults.", "number", "1" },
+        { "timeout", "Give up on a level after this many seconds.", "seconds", "600" },
+    });
+    parser.process(arguments);
+
+    DownloadBenchConfig config;
+    config.files = qMax(1, parser.value("files").toInt());
+    config.fileSize = qMax<qint64>(1, parser.value("size").toLongLong());
+    config.catalogEntries = qMax(0, parser.value("catalog").toInt());
+    config.adaptive = parser.isSet("adaptive");
+    config.timeoutMs = qMax(1, parser.value("timeout").toInt()) * 1000;
+
+    MockServerConfig serverConfig;
+    serverConfig.latencyMs = parser.value("latency").toInt();
+    serverConfig.bytesPerSecond = parser.value("bandwidth").toLongLong();
+    serverConfig.chunkSize = qMax(1, parser.value("chunk").toInt());
+    serverConfig.failureRate = parser.value("fail-rate").toDouble();
+    serverConfig.throttleRate = parser.value("throttle-rate").toDouble();
+    serverConfig.retryAfterSeconds = parser.value("retry-after").toInt();
+    serverConfig.ranges = !parser.isSet("no-ranges");
+    serverConfig.seed = parser.value("seed").toUInt();
+
+    QList<int> levels;
+    for (const QString& level : parser.value("concurrency").split(',', Qt::SkipEmptyParts)) {
+        if (level.toInt() > 0) levels.append(level.toInt());
+    }
+
+    QTextStream out(stdout);
+
+    // The server gets its own thread so its pacing never competes with the client's event loop
+    MockServer* server = new MockServer(serverConfig);
+    server->addResource("/filelist.json", syntheticCatalog(config.catalogEntries, serverConfig.seed));
+    const QByteArray archive = syntheticArchive(config.fileSize, serverConfig.seed);
+    for (int i = 0; i < config.files; i++) {
+        server->addResource(QString("/files/%1.zip").arg(i), archive);
+    }
+
+    QThread serverThread;
+    server->moveToThread(&serverThread);
+    QObject::connect(&serverThread, &QThread::finished, server, &QObject::deleteLater);
+    serverThread.start();
+
+    bool listening = false;
+    QMetaObject::invokeMethod(server, &MockServer::listen, Qt::BlockingQueuedConnection, &listening);
+    if (!listening) {
+        QTextStream(stderr) << "Mock server failed to listen\n";
+        serverThread.quit();
+        serverThread.wait();
+        return 1;
+    }
+
+    out << "files=" << config.files << " size=" << config.fileSize << " catalog=" << config.catalogEntries
+        << " latency=" << serverConfig.latencyMs << "ms bandwidth=" << serverConfig.bytesPerSecond
+        << " fail=" << serverConfig.failureRate << " throttle=" << serverConfig.throttleRate
+        << (config.adaptive ? " adaptive" : " fixed") << Qt::endl;
+    out << "level  catalog_ms  wall_ms    MiB/s  p50_ms  p99_ms  failed  requests  429s  cut  ranged  limit  threads  peak_rss_MiB" << Qt::endl;
+
+    int exitCode = 0;
+    for (int level : levels) {
+        QTemporaryDir dir;
+
+        // Same arrangement as the application: the client owns a dedicated network thread
+        QThread networkThread;
+        HttpClient* client = new HttpClient(level);
+        client->moveToThread(&networkThread);
+        QObject::connect(&networkThread, &QThread::finished, client, &QObject::deleteLater);
+        networkThread.start();
+        client->setConcurrencyBounds(config.adaptive ? 1 : level, level);
+
+        const int requestsBefore = server->requests();
+        const int throttledBefore = server->throttled();
+        const int failedBefore = server->failed();
+        const int rangedBefore = server->ranged();
+
+        const LevelResult result = runLevel(client, server, config, dir.path());
+
+        networkThread.quit();
+        networkThread.wait();
+
+        const ProcessStats process = sampleProcess();
+        const double seconds = qMax<qint64>(1, result.wallMs) / 1000.0;
+
+        out << qSetFieldWidth(5) << level << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(10) << result.catalogMs << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(7) << result.wallMs << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(7) << QString::number(toMiB(result.bytes) / seconds, 'f', 1) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(6) << percentile(result.latencies, 0.50) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(6) << percentile(result.latencies, 0.99) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(6) << result.failed << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(8) << server->requests() - requestsBefore << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(4) << server->throttled() - throttledBefore << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(3) << server->failed() - failedBefore << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(6) << server->ranged() - rangedBefore << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(5) << result.hostLimit << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(7) << result.maxThreads << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(12) << QString::number(toMiB(process.peakRssBytes), 'f', 1) << qSetFieldWidth(0)
+            << (result.timedOut ? "  (timed out)" : "") << Qt::endl;
+
+        if (result.timedOut || result.failed > 0) {
+            exitCode = 2;
+        }
+    }
+
+    serverThread.quit();
+    serverThread.wait();
+    return exitCode;
+}
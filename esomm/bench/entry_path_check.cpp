@@ -0,0 +1,51 @@
+#include "benches.h"
+#include "archive_extractor.h"
+
+#include <QTextStream>
+
+// Regression check for archive entry names, exits non-zero if any is handled wrongly. "./x" used
+// to make "." a top-level folder, and replacing that folder wiped all of AddOns
+int runEntryPathCheck(const QStringList& arguments) {
+    Q_UNUSED(arguments);
+
+    struct Case {
+        QString name;
+        QString expected; // Joined segments, empty when the name must be refused
+    };
+    const QList<Case> cases = {
+        { "MyAddon/MyAddon.txt", "MyAddon/MyAddon.txt" },
+        { "MyAddon/", "MyAddon" },
+        { "MyAddon//lib/a.lua", "MyAddon/lib/a.lua" },
+        { "MyAddon/v1.2/a.lua", "MyAddon/v1.2/a.lua" },
+        { "./x", "" },
+        { "a/../b", "" },
+        { "a/./b", "" },
+        { ".", "" },
+        { "..", "" },
+        { "", "" },
+        { "/abs/a.lua", "" },
+        { "C:/a.lua", "" },
+        { "a\\b", "" },
+        { "a./b", "" },
+        { "a /b", "" },
+        { "MyAddon/con.txt", "" },
+        { "MyAddon/COM1", "" },
+        { "NUL/a.lua", "" },
+    };
+
+    QTextStream out(stdout);
+    int failures = 0;
+    for (const Case& test : cases) {
+        QStringList parts;
+        const bool accepted = ArchiveExtractor::splitEntryPath(test.name, &parts);
+        const QString actual = accepted ? parts.join('/') : QString();
+        if (accepted != !test.expected.isEmpty() || actual != test.expected) {
+            out << "FAIL \"" << test.name << "\": expected " << (test.expected.isEmpty() ? "refused" : test.expected)
+                << ", got " << (accepted ? actual : "refused") << Qt::endl;
+            failures++;
+        }
+    }
+
+    out << (cases.size() - failures) << " of " << cases.size() << " entry names handled as expected" << Qt::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include "mock_server.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QCryptographicHash>
+
+MockServer::MockServer(const MockServerConfig& config, QObject* parent)
+    : QObject(parent), m_config(config), m_server(new QTcpServer(this)), m_random(config.seed) {
+
+    connect(m_server, &QTcpServer::newConnection, this, &MockServer::onNewConnection);
+}
+
+void MockServer::addResource(const QString& path, const QByteArray& body) {
+    const QByteArray etag = '"' + QCryptographicHash::hash(body, QCryptographicHash::Md5).toHex().left(16) + '"';
+    m_resources.insert(path, { body, etag });
+}
+
+bool MockServer::listen() {
+    if (!m_server->listen(QHostAddress::LocalHost, 0)) {
+        return false;
+    }
+    m_port = m_server->serverPort();
+    return true;
+}
+
+QUrl MockServer::url(const QString& path) const {
+    return QUrl(QString("http://127.0.0.1:%1%2").arg(m_port).arg(path));
+}
+
+void MockServer::onNewConnection() {
+    while (QTcpSocket* socket = m_server->nextPendingConnection()) {
+        m_connections.insert(socket, Connection());
+
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+            m_connections[socket].buffer += socket->readAll();
+            processBuffer(socket);
+        });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+// Requests on a keep-alive connection are answered one at a time, in order
+void MockServer::processBuffer(QTcpSocket* socket) {
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || it->busy) return;
+
+    const qsizetype end = it->buffer.indexOf("\r\n\r\n");
+    if (end < 0) return;
+
+    const QByteArray head = it->buffer.left(end);
+    it->buffer.remove(0, end + 4);
+    it->busy = true;
+
+    m_requests.ref();
+
+    if (m_config.latencyMs > 0) {
+        QTimer::singleShot(m_config.latencyMs, socket, [this, socket, head]() { respond(socket, head); });
+    } else {
+        respond(socket, head);
+    }
+}
+
+void MockServer::respond(QTcpSocket* socket, const QByteArray& head) {
+    const QList<QByteArray> lines = head.split('\n');
+    const QList<QByteArray> requestLine = lines.value(0).trimmed().split(' ');
+    const QString path = QString::fromLatin1(requestLine.value(1));
+
+    QHash<QByteArray, QByteArray> headers;
+    for (qsizetype i = 1; i < lines.size(); i++) {
+        const qsizetype colon = lines[i].indexOf(':');
+        if (colon > 0) {
+            headers.insert(lines[i].left(colon).trimmed().toLower(), lines[i].mid(colon + 1).trimmed());
+        }
+    }
+
+    auto reply = [socket](const QByteArray& status, const QByteArray& extraHeaders, qint64 length) {
+        socket->write("HTTP/1.1 " + status + "\r\n"
+            + "Content-Length: " + QByteArray::number(length) + "\r\n"
+            + "Connection: keep-alive\r\n"
+            + extraHeaders + "\r\n");
+    };
+
+    const auto resource = m_resources.constFind(path);
+    if (resource == m_resources.constEnd()) {
+        reply("404 Not Found", QByteArray(), 0);
+        finishResponse(socket);
+        return;
+    }
+
+    if (m_config.throttleRate > 0 && m_random.generateDouble() < m_config.throttleRate) {
+        m_throttled.ref();
+        reply("429 Too Many Requests", "Retry-After: " + QByteArray::number(m_config.retryAfterSeconds) + "\r\n", 0);
+        finishResponse(socket);
+        return;
+    }
+
+    const QByteArray& body = resource->body;
+    const QByteArray validators = "ETag: " + resource->etag + "\r\n"
+        + (m_config.ranges ? "Accept-Ranges: bytes\r\n" : "");
+
+    if (headers.value("if-none-match") == resource->etag) {
+        reply("304 Not Modified", validators, 0);
+        finishResponse(socket);
+        return;
+    }
+
+    // Range is only honored while If-Range still names the current representation
+    qint64 offset = 0;
+    const QByteArray range = headers.value("range");
+    const QByteArray ifRange = headers.value("if-range");
+    if (m_config.ranges && range.startsWith("bytes=") && (ifRange.isEmpty() || ifRange == resource->etag)) {
+        offset = range.mid(6, range.indexOf('-') - 6).toLongLong();
+        if (offset >= body.size()) {
+            reply("416 Range Not Satisfiable", "Content-Range: bytes */" + QByteArray::number(body.size()) + "\r\n", 0);
+            finishResponse(socket);
+            return;
+        }
+        m_ranged.ref();
+    }
+
+    const qint64 length = body.size() - offset;
+    if (offset > 0) {
+        reply("206 Partial Content", validators + "Content-Range: bytes " + QByteArray::number(offset) + "-"
+            + QByteArray::number(body.size() - 1) + "/" + QByteArray::number(body.size()) + "\r\n", length);
+    } else {
+        reply("200 OK", validators + "Content-Type: application/octet-stream\r\n", length);
+    }
+
+    qint64 cutOffAfter = -1;
+    if (m_config.failureRate > 0 && m_random.generateDouble() < m_config.failureRate) {
+        m_failed.ref();
+        cutOffAfter = length / 2;
+    }
+    sendBody(socket, body, offset, cutOffAfter);
+}
+
+// Writes the body in chunks paced to the configured bandwidth; a cut-off drops the connection midway
+void MockServer::sendBody(QTcpSocket* socket, const QByteArray& body, qint64 offset, qint64 cutOffAfter) {
+    const qint64 end = cutOffAfter >= 0 ? offset + cutOffAfter : body.size();
+    const int interval = m_config.bytesPerSecond > 0
+        ? qMax<int>(1, int(m_config.chunkSize * 1000 / m_config.bytesPerSecond))
+        : 0;
+
+    QTimer* timer = new QTimer(socket);
+    connect(timer, &QTimer::timeout, socket, [this, socket, timer, body, offset, end, cutOffAfter]() mutable {
+        // Unpaced bodies are written whole, the socket buffers them
+        const qint64 chunk = m_config.bytesPerSecond > 0 ? m_config.chunkSize : end - offset;
+        const qint64 size = qMin(chunk, end - offset);
+        socket->write(body.constData() + offset, size);
+        offset += size;
+
+        if (offset < end) return;
+
+        timer->stop();
+        timer->deleteLater();
+
+        if (cutOffAfter >= 0) {
+            socket->flush();
+            socket->abort();
+        } else {
+            finishResponse(socket);
+        }
+    });
+    timer->start(interval);
+}
+
+void MockServer::finishResponse(QTcpSocket* socket) {
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end()) return;
+
+    it->busy = false;
+    processBuffer(socket);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QUrl>
+#include <QAtomicInt>
+#include <QRandomGenerator>
+
+class QTcpServer;
+class QTcpSocket;
+
+struct MockServerConfig {
+    int latencyMs = 0;           // Delay before the response headers
+    qint64 bytesPerSecond = 0;   // Per connection, 0 sends as fast as the socket takes it
+    int chunkSize = 16 * 1024;   // Bytes written per pacing tick
+    double failureRate = 0;      // Share of responses cut off halfway through the body
+    double throttleRate = 0;     // Share of requests answered with 429
+    int retryAfterSeconds = 1;
+    bool ranges = true;          // Honor Range/If-Range
+    quint32 seed = 1;
+};
+
+// Minimal HTTP/1.1 stand-in for the mmoui API. Serves fixed resources over keep-alive
+// connections with configurable latency, bandwidth, failures, throttling and byte ranges.
+// Resources must be added before the server is started; it can then live on any thread.
+class MockServer : public QObject {
+    Q_OBJECT
+
+public:
+    explicit MockServer(const MockServerConfig& config, QObject* parent = nullptr);
+
+    void addResource(const QString& path, const QByteArray& body);
+
+    Q_INVOKABLE bool listen();
+    QUrl url(const QString& path) const;
+
+    int requests() const { return m_requests.loadRelaxed(); }
+    int throttled() const { return m_throttled.loadRelaxed(); }
+    int failed() const { return m_failed.loadRelaxed(); }
+    int ranged() const { return m_ranged.loadRelaxed(); }
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct Resource {
+        QByteArray body;
+        QByteArray etag;
+    };
+
+    struct Connection {
+        QByteArray buffer;
+        bool busy = false;
+    };
+
+    MockServerConfig m_config;
+    QTcpServer* m_server;
+    QHash<QString, Resource> m_resources;
+    QHash<QTcpSocket*, Connection> m_connections;
+    QRandomGenerator m_random;
+    quint16 m_port = 0;
+
+    QAtomicInt m_requests = 0;
+    QAtomicInt m_throttled = 0;
+    QAtomicInt m_failed = 0;
+    QAtomicInt m_ranged = 0;
+
+    void processBuffer(QTcpSocket* socket);
+    void respond(QTcpSocket* socket, const QByteArray& head);
+    void sendBody(QTcpSocket* socket, const QByteArray& body, qint64 offset, qint64 cutOffAfter);
+    void finishResponse(QTcpSocket* socket);
+};
@@ -0,0 +1,147 @@
+#include "benches.h"
+#include "bench_util.h"
+#include "catalog_parser.h"
+#include "catalog_store.h"
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QTextStream>
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+
+// Median of runs, in microseconds. The checksum keeps the work from being optimised away
+static double medianMicros(int runs, qint64* checksum, const std::function<qint64()>& work) {
+    QList<qint64> times;
+    for (int i = 0; i < runs; i++) {
+        QElapsedTimer clock;
+        clock.start();
+        *checksum += work();
+        times.append(clock.nsecsElapsed());
+    }
+    return percentile(times, 0.5) / 1000.0;
+}
+
+int runStoreBench(const QStringList& arguments) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares catalog filters and sorts on QList<ModInfo> against the columnar CatalogStore.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "file", "Catalog to load, e.g. a saved filelist.json. A synthetic one is generated otherwise.", "path" },
+        { "entries", "Entries in the synthetic catalog.", "count", "10000" },
+        { "installed", "Share of entries marked installed.", "ratio", "0.05" },
+        { "lookups", "Id lookups per run.", "count", "1000" },
+        { "runs", "Runs per operation, the median is reported.", "count", "21" },
+        { "seed", "Seed for the synthetic catalog and the installed set.", "number", "1" },
+    });
+    parser.process(arguments);
+
+    const int runs = qMax(1, parser.value("runs").toInt());
+    const int lookups = qMax(1, parser.value("lookups").toInt());
+    const double installedShare = qBound(0.0, parser.value("installed").toDouble(), 1.0);
+
+    QTemporaryDir dir;
+    const QString filePath = benchCatalogPath(parser, dir);
+    if (filePath.isEmpty()) return 1;
+
+    QList<ModInfo> list;
+    QString error;
+    if (!CatalogParser::parseFileParallel(filePath, &list, &error)) {
+        QTextStream(stderr) << "Failed to decode " << filePath << ": " << error << "\n";
+        return 2;
+    }
+
+    // Same installed and update state in both layouts
+    QRandomGenerator random(parser.value("seed").toUInt());
+    for (ModInfo& mod : list) {
+        mod.isInstalled = random.generateDouble() < installedShare;
+        mod.hasUpdate = mod.isInstalled && random.bounded(4) == 0;
+        if (mod.isInstalled) mod.installPath = "AddOns/" + mod.title;
+    }
+    CatalogStore store;
+    store.assign(QList<ModInfo>(list));
+
+    QStringList ids;
+    for (int i = 0; i < lookups && !list.isEmpty(); i++) {
+        ids.append(list[random.bounded(int(list.size()))].id);
+    }
+
+    QTextStream out(stdout);
+    out << "entries=" << list.size() << " installed=" << store.rowsWith(CatalogStore::Installed).size()
+        << " runs=" << runs << Qt::endl;
+    out << "operation            list_us    store_us  speedup" << Qt::endl;
+
+    qint64 checksum = 0;
+    const auto report = [&](const QString& operation, const std::function<qint64()>& onList, const std::function<qint64()>& onStore) {
+        const double listUs = medianMicros(runs, &checksum, onList);
+        const double storeUs = medianMicros(runs, &checksum, onStore);
+        out << qSetFieldWidth(18) << Qt::left << operation << qSetFieldWidth(0) << Qt::right << "  "
+            << qSetFieldWidth(9) << QString::number(listUs, 'f', 1) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(9) << QString::number(storeUs, 'f', 1) << qSetFieldWidth(0) << "  "
+            << qSetFieldWidth(6) << QString::number(listUs / qMax(storeUs, 0.001), 'f', 2) << "x" << qSetFieldWidth(0) << Qt::endl;
+    };
+
+    // Filters return row numbers in both layouts, copying records out would dominate either way
+    report("available", [&]() {
+        QList<int> rows;
+        for (int i = 0; i < list.size(); i++) {
+            if (!list[i].isInstalled) rows.append(i);
+        }
+        return qint64(rows.size());
+    }, [&]() {
+        return qint64(store.rowsWith(0, CatalogStore::Installed).size());
+    });
+
+    report("with-updates", [&]() {
+        QList<int> rows;
+        for (int i = 0; i < list.size(); i++) {
+            if (list[i].isInstalled && list[i].hasUpdate) rows.append(i);
+        }
+        return qint64(rows.size());
+    }, [&]() {
+        return qint64(store.rowsWith(CatalogStore::Installed | CatalogStore::HasUpdate).size());
+    });
+
+    report("find-id", [&]() {
+        qint64 sum = 0;
+        for (const QString& id : ids) {
+            for (int i = 0; i < list.size(); i++) {
+                if (!list[i].isInstalled && list[i].id == id) {
+                    sum += i;
+                    break;
+                }
+            }
+        }
+        return sum;
+    }, [&]() {
+        qint64 sum = 0;
+        for (const QString& id : ids) sum += store.findId(id, 0, CatalogStore::Installed);
+        return sum;
+    });
+
+    const auto sortReport = [&](const QString& operation, CatalogSortKey key, const std::function<bool(const ModInfo&, const ModInfo&)>& less) {
+        report(operation, [&]() {
+            QList<int> rows(list.size());
+            std::iota(rows.begin(), rows.end(), 0);
+            std::stable_sort(rows.begin(), rows.end(), [&](int a, int b) { return less(list[b], list[a]); });
+            return qint64(rows.value(0));
+        }, [&]() {
+            QList<int> rows(store.size());
+            std::iota(rows.begin(), rows.end(), 0);
+            store.sortRows(&rows, key, Qt::DescendingOrder);
+            return qint64(rows.value(0));
+        });
+    };
+    sortReport("sort-downloads", CatalogSortKey::Downloads, [](const ModInfo& a, const ModInfo& b) {
+        return a.downloads < b.downloads;
+    });
+    sortReport("sort-updated", CatalogSortKey::LastUpdated, [](const ModInfo& a, const ModInfo& b) {
+        return a.lastUpdated < b.lastUpdated;
+    });
+
+    out << "checksum=" << checksum << Qt::endl;
+    return 0;
+}
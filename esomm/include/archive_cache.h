@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QString>
+#include <QHash>
+
+constexpr qint64 ARCHIVE_CACHE_DEFAULT_MAX_BYTES = 2LL * 1024 * 1024 * 1024; // 2 GiB
+
+// Content-addressed store of downloaded mod archives, one <checksum>.zip per catalog checksum.
+// Archives are never rewritten once stored; the least recently used ones are evicted when the
+// store grows past its size cap, except those pinned by an install still waiting to read them.
+// Used from the GUI thread only.
+class ArchiveCache {
+public:
+    explicit ArchiveCache(const QString& rootPath, qint64 maxBytes = ARCHIVE_CACHE_DEFAULT_MAX_BYTES);
+
+    static bool isValidKey(const QString& checksum);
+
+    QString pathFor(const QString& checksum) const;
+    bool contains(const QString& checksum);
+    void insert(const QString& checksum);
+    void touch(const QString& checksum);
+    void remove(const QString& checksum);
+
+    // Pinned archives are never evicted. Pins nest, each pin() needs its unpin()
+    void pin(const QString& checksum);
+    void unpin(const QString& checksum);
+
+    void setMaxBytes(qint64 maxBytes);
+    qint64 maxBytes() const;
+    qint64 totalBytes() const;
+
+private:
+    struct Entry {
+        qint64 size = 0;
+        qint64 lastUsed = 0; // msecs since epoch
+    };
+
+    QString m_rootPath;
+    qint64 m_maxBytes;
+    qint64 m_totalBytes = 0;
+    QHash<QString, Entry> m_entries;
+    QHash<QString, int> m_pins;
+
+    QString indexPath() const;
+    void loadIndex();
+    void saveIndex() const;
+    void evict(const QString& keep = QString());
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include "http_client.h"
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QQueue>
+#include <QSet>
+#include <QFile>
+#include <QMutex>
+#include <QPointer>
+
+#include <functional>
+#include <memory>
+
+constexpr qint64 EXTRACT_BUFFER_SIZE = 64 * 1024; // Inflate output and file read chunk
+constexpr qint64 EXTRACT_MAX_QUEUED_BYTES = 4 * 1024 * 1024; // Streamed input waiting for the worker, past it the finished file is extracted instead
+
+// Unpacks a zip archive into a staging directory while it is still downloading. Local file
+// headers are parsed and entries inflated as bytes arrive, so by the time the last byte is on
+// disk the archive is already extracted. Work runs as a thread pool task that only exists while
+// input is queued; no thread waits on the network.
+//
+// Fed either as a DownloadSink (network thread) or from a finished file with extractFile(),
+// which reads the central directory and inflates entries in parallel instead.
+class ArchiveExtractor : public DownloadSink, public std::enable_shared_from_this<ArchiveExtractor> {
+public:
+    struct Result {
+        bool success = false;
+        QString error;
+        bool corrupt = false; // The archive itself is damaged (bad headers, inflate error or CRC mismatch), not the disk
+        QString stagingPath;
+        QStringList topLevelEntries; // Names directly under stagingPath, normally the addon folders
+        int files = 0;
+        qint64 bytesWritten = 0;
+
+        // Delta extraction only, see setDeltaBase()
+        bool delta = false;
+        QStringList changedFiles;  // Staged files that are new or differ from the live copy, relative paths
+        QStringList removedFiles;  // Live files the archive no longer contains, relative paths
+        int unchangedFiles = 0;
+        qint64 bytesSkipped = 0;   // Identical on disk, never rewritten
+    };
+
+    explicit ArchiveExtractor(const QString& stagingPath);
+    ~ArchiveExtractor();
+
+    void begin(const QString& partPath, qint64 offset) override;
+    void write(const char* data, qint64 size) override;
+
+    void extractFile(const QString& archivePath); // Whole archive on disk, entries extracted in parallel
+    // extractFile() only stages entries that differ from their copy under liveRoot (by size and
+    // CRC-32) and lists live files the archive dropped. Call before extractFile()
+    void setDeltaBase(const QString& liveRoot);
+
+    // No more input follows; done runs on context's thread once everything queued is extracted
+    void finish(QObject* context, std::function<void(const Result&)> done);
+    // Drops queued input and the staging directory, done is never called
+    void cancel();
+
+    // Splits a zip entry name into path segments. Refuses anything that could land outside the
+    // staging dir or that Windows would resolve to another name: absolute paths, backslashes,
+    // drive letters, "." and "..", trailing dots or spaces and reserved device names
+    static bool splitEntryPath(const QString& name, QStringList* parts);
+    static bool isPlainSegment(const QString& segment);
+
+private:
+    struct Input {
+        QByteArray data;
+        QString filePath; // Read on the worker instead of data
+        QString partPath; // [partFrom, partTo) of an earlier session's part file, read on the worker
+        qint64 partFrom = 0;
+        qint64 partTo = 0;
+        QString error;    // The feeding side lost track of the body, fail the extraction
+        bool reset = false; // The body starts over, throw away what was extracted
+    };
+
+    enum class State {
+        Header,
+        Data,
+        Descriptor,
+        Done,  // Central directory reached, the rest of the archive holds no file data
+        Failed
+    };
+
+    struct Entry {
+        QString name;
+        quint16 method = 0;
+        quint32 expectedCrc = 0;
+        quint32 crc = 0;
+        qint64 remaining = 0; // Compressed bytes left, stored entries only
+        bool descriptor = false;
+        bool zip64 = false;
+        bool directory = false;
+    };
+
+    // Central directory record of an entry in a finished archive
+    struct ZipEntry {
+        QString name;
+        QString relativePath;
+        QString targetPath;
+        quint16 method = 0;
+        quint32 crc = 0;
+        qint64 size = 0;
+        qint64 compressedSize = 0;
+        qint64 localOffset = 0;
+    };
+
+    struct Inflater;
+
+    const QString m_stagingPath;
+    QString m_deltaBase;
+
+    // Shared between the feeding thread and the worker
+    QMutex m_mutex;
+    QQueue<Input> m_input;
+    qint64 m_queuedBytes = 0; // Of the data held in m_input
+    bool m_draining = false;
+    bool m_closed = false;
+    bool m_cancelled = false;
+    QPointer<QObject> m_context;
+    std::function<void(const Result&)> m_done;
+
+    // Sink side, only touched by the thread feeding the extractor
+    qint64 m_received = 0;
+    qint64 m_skip = 0;
+    bool m_overflowed = false; // Fell behind and gave up, later input is ignored
+
+    // Worker side, only touched by the running drain task
+    State m_state = State::Header;
+    QString m_error;
+    bool m_corrupt = false;
+    QByteArray m_pending;
+    Entry m_entry;
+    QFile m_file;
+    std::unique_ptr<Inflater> m_inflater;
+    QSet<QString> m_topLevel;
+    int m_files = 0;
+    qint64 m_bytesWritten = 0;
+    QStringList m_changedFiles;
+    QStringList m_removedFiles;
+    int m_unchangedFiles = 0;
+    qint64 m_bytesSkipped = 0;
+
+    void push(Input input);
+    void overflow();
+    void scheduleDrain();
+    void drain();
+    bool isCancelled();
+    void complete(QObject* context, const std::function<void(const Result&)>& done);
+
+    void reset();
+    void consume(const QByteArray& data);
+    void consumePart(const Input& input);
+    void extractArchive(const QString& filePath);
+    bool findRemovedFiles(const QSet<QString>& archiveFiles);
+    void parse();
+    bool openEntry(const char* header, int nameLength, int extraLength);
+    qint64 copyStored(const char* data, qint64 size);
+    qint64 inflateData(const char* data, qint64 size);
+    bool writeOutput(const char* data, qint64 size);
+    void finishEntry(quint32 crc);
+    void fail(const QString& error, bool corrupt = false);
+
+    static bool readCentralDirectory(QFile& archive, QList<ZipEntry>* entries, QString* error, bool* corrupt);
+    static bool matchesFile(const QString& filePath, qint64 size, quint32 crc);
+    static bool extractEntry(const QString& archivePath, const ZipEntry& entry, qint64* written, QString* error, bool* corrupt);
+};
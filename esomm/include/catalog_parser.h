@@ -0,0 +1,87 @@
+#pragma once
+
+#include "ModType.h"
+#include "string_pool.h"
+
+#include <QString>
+#include <QByteArray>
+
+#include <atomic>
+#include <functional>
+
+class QThreadPool;
+
+constexpr int CATALOG_MAX_DEPTH = 64; // Nesting skipped inside unknown fields before the input is rejected
+constexpr int CATALOG_MIN_CHUNK_ENTRIES = 64; // Smallest unit of parallel decoding
+
+struct CatalogParseOptions {
+    QThreadPool* pool = nullptr;                  // Parallel decoding threads, the global pool if null
+    const std::atomic<bool>* cancelled = nullptr; // Checked between chunks of a parallel decode
+    bool internStrings = true;                    // Share repeated field values through a StringPool
+    StringPool* strings = nullptr;                // Pool to intern into, a private one per load if null
+};
+
+// Pull parser for the mmoui file list (master.json). Decodes ModInfo records straight from
+// the raw bytes, one catalog entry at a time, without building a QJsonDocument. The input is
+// not copied, so it has to outlive the parser; parseFile() memory-maps the catalog.
+//
+// Field semantics follow QJsonValue: a value of the wrong type reads as empty/zero. Input that
+// QJsonDocument would reject (bad literals or numbers, bytes after the array) fails the parse.
+class CatalogParser {
+public:
+    CatalogParser(const char* data, qint64 size);
+
+    bool enterArray();       // Consumes the catalog's opening '['
+    bool next(ModInfo* mod); // Decodes the next entry; false at the closing ']' or on error
+    bool skipEntry();        // Steps over the next entry without decoding it, same return as next()
+
+    // Repeated fields (author, category, versions, dependency names) are interned into strings
+    void setStringPool(StringPool* strings) { m_strings = strings; }
+
+    bool atEnd() const { return m_done; }
+    bool hasError() const { return !m_error.isEmpty(); }
+    QString errorString() const { return m_error; }
+    qint64 position() const { return m_pos - m_begin; }
+
+    // Maps filePath and hands every entry to onMod as soon as it is decoded. Returns false with
+    // *error set when the file cannot be read or is malformed; entries before the fault were delivered
+    static bool parseFile(const QString& filePath, const std::function<void(ModInfo&&)>& onMod, QString* error,
+        const CatalogParseOptions& options = {});
+
+    // Decodes the whole catalog on every core and appends it to *mods in catalog order.
+    // Nothing is appended when the input is malformed or the load is cancelled
+    static bool parseFileParallel(const QString& filePath, QList<ModInfo>* mods, QString* error,
+        const CatalogParseOptions& options = {});
+    static bool parseParallel(const char* data, qint64 size, QList<ModInfo>* mods, QString* error,
+        const CatalogParseOptions& options = {});
+
+private:
+    CatalogParser(const char* data, qint64 size, qint64 start); // Resumes mid-array at start
+
+    const char* const m_begin;
+    const char* m_pos;
+    const char* const m_end;
+    QString m_error;
+    bool m_first = true; // No ',' before the next entry
+    bool m_done = false;
+    StringPool* m_strings = nullptr;
+
+    bool beginEntry();
+    void skipWhitespace();
+    bool peek(char c);
+    bool expect(char c);
+    bool readKey(QByteArray* key, QByteArray* scratch);
+    bool readString(QString* value, bool intern = false);
+    bool scanString(const char** start, qint64* length, bool* escaped);
+    bool scanNumber();
+    bool scanLiteral();
+    bool readInt(int* value);
+    bool readBool(bool* value);
+    bool readStringList(QList<QString>* values, bool intern = false);
+    bool skipValue(int depth = 0);
+    bool parseMod(ModInfo* mod);
+    bool parseAddon(Dependancies* addon);
+    bool fail(const char* what);
+
+    static QByteArray unescape(const char* start, qint64 length, bool* ok);
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ModType.h"
+
+#include <QString>
+#include <QList>
+#include <QFileInfo>
+#include <QDateTime>
+
+constexpr quint32 CATALOG_SNAPSHOT_VERSION = 1; // Bump whenever the layout or ModInfo's persisted fields change
+
+// Binary copy of the decoded catalog, written after every successful parse so the next launch
+// can show the catalog without waiting for the network or the JSON decoder. The file is mapped
+// and decoded in one pass: a deduplicated UTF-16 string table followed by fixed-order records
+// that refer to it. Snapshots of another version or byte order are ignored, never migrated.
+//
+// Safe to call from any thread; nothing is shared between calls.
+class CatalogSnapshot {
+public:
+    // sourceSize and sourceModified describe the master.json the catalog was decoded from, as it was
+    // before it was read, and are remembered to tell whether the snapshot is still current
+    static bool save(const QString& path, const QList<ModInfo>& mods, qint64 sourceSize, const QDateTime& sourceModified);
+    static bool load(const QString& path, QList<ModInfo>* mods, QString* error);
+
+    // Reads the header only
+    static bool isBuiltFrom(const QString& path, const QFileInfo& source);
+};
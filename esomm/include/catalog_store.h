@@ -0,0 +1,109 @@
+#pragma once
+
+#include "ModType.h"
+
+#include <QString>
+#include <QList>
+#include <QMultiHash>
+#include <QPair>
+
+#include <limits>
+
+constexpr qint64 CATALOG_NO_TIMESTAMP = std::numeric_limits<qint64>::min(); // lastUpdated() of an undated entry
+
+enum class CatalogSortKey {
+    Title,
+    Downloads,
+    DownloadsMonthly,
+    Favorites,
+    LastUpdated
+};
+
+// What a freshly decoded catalog changes against the store, keyed on mod id. An entry counts as
+// changed when its version, checksum or lastUpdate differs; download counts alone only refresh
+// the counters
+struct CatalogDiff {
+    QList<int> added;                  // Positions in the incoming list
+    QList<int> removed;                // Rows of the store
+    QList<QPair<int, int>> changed;    // Row, position in the incoming list
+    QList<QPair<int, int>> recounted;  // Row, position in the incoming list
+
+    bool isEmpty() const { return added.isEmpty() && removed.isEmpty() && changed.isEmpty(); }
+};
+
+// Column-oriented catalog. The fields filters and sorts read (id, title, state flags, download
+// counts, timestamp) live in parallel contiguous arrays, so a full-catalog scan touches only the
+// bytes it compares. Complete ModInfo records are kept apart and only read when a row is handed
+// out. Rows are stable until the store is reassigned, cleared or a diff removing entries is applied.
+//
+// State changes go through the setters, which keep columns, records and the lookup indexes in
+// step. Ids, titles and the addon folders each mod ships are hashed to their rows.
+class CatalogStore {
+public:
+    enum Flag : quint8 {
+        Installed = 0x01,
+        HasUpdate = 0x02,
+        Library = 0x04
+    };
+
+    void clear();
+    void assign(QList<ModInfo>&& mods);
+    int append(ModInfo mod); // Returns the new row
+
+    // Applying a diff keeps the install state of changed rows, appends added entries and
+    // compacts removed ones away, so row numbers taken before it are void
+    CatalogDiff diff(const QList<ModInfo>& incoming) const;
+    void apply(const CatalogDiff& diff, QList<ModInfo>&& incoming);
+
+    int size() const { return int(m_ids.size()); }
+    bool isEmpty() const { return m_ids.isEmpty(); }
+
+    // Hot columns
+    const QString& id(int row) const { return m_ids[row]; }
+    const QString& title(int row) const { return m_titles[row]; }
+    quint8 flags(int row) const { return m_flags[row]; }
+    bool hasFlags(int row, quint8 flags) const { return (m_flags[row] & flags) == flags; }
+    int downloads(int row) const { return m_downloads[row]; }
+    int downloadsMonthly(int row) const { return m_downloadsMonthly[row]; }
+    int favorites(int row) const { return m_favorites[row]; }
+    qint64 lastUpdated(int row) const { return m_lastUpdated[row]; } // msecs since epoch
+
+    // Cold record with every field
+    const ModInfo& at(int row) const { return m_records[row]; }
+    QList<ModInfo> records(const QList<int>& rows) const;
+
+    void setInstalled(int row, const QString& installPath); // Empty path marks the row not installed
+    void setHasUpdate(int row, bool hasUpdate);
+    void clearFlags(quint8 flags); // On every row
+
+    // Rows must have every flag in set and none in unset. rowsWith scans the flag column, the
+    // finds are hash lookups returning the lowest matching row or -1
+    QList<int> rowsWith(quint8 set, quint8 unset = 0) const;
+    int findId(const QString& id, quint8 set = 0, quint8 unset = 0) const;
+    int findTitle(const QString& title, quint8 set = 0, quint8 unset = 0) const;
+    QList<int> rowsWithFolder(const QString& folder) const; // Rows listing the folder in their addons, ascending
+    void sortRows(QList<int>* rows, CatalogSortKey key, Qt::SortOrder order = Qt::AscendingOrder) const;
+
+private:
+    QList<QString> m_ids;
+    QList<QString> m_titles;
+    QList<quint8> m_flags;
+    QList<int> m_downloads;
+    QList<int> m_downloadsMonthly;
+    QList<int> m_favorites;
+    QList<qint64> m_lastUpdated;
+
+    QList<ModInfo> m_records;
+
+    QMultiHash<QString, int> m_idIndex;
+    QMultiHash<QString, int> m_titleIndex;
+    QMultiHash<QString, int> m_folderIndex; // Dependancies::path
+
+    void setFlag(int row, Flag flag, bool on);
+    void indexRow(int row);
+    void unindexRow(int row);
+    void reindex();
+    int findIndexed(const QMultiHash<QString, int>& index, const QString& key, quint8 set, quint8 unset) const;
+    void setRecord(int row, ModInfo mod);
+    void removeRows(QList<int> rows);
+};
@@ -38,6 +38,7 @@ private slots:
     void onInstalledModClicked(QListWidgetItem* item);
     void onRefreshInstalledClicked();
     void onUpdateModClicked();
+    void onUpdateAllClicked();
     void onUninstallModClicked();
     void onManageClicked();
     void onBrowseClicked();
@@ -48,4 +49,5 @@ private slots:
     void onAvailableModsChanged();
     void onModActionStarted(const QString& action, const QString& modTitle);
     void onModActionCompleted(const QString& action, const QString& modTitle, bool success);
+    void onModsUpdated(const QStringList& updatedTitles, const QStringList& failedTitles);
 };
@@ -3,22 +3,94 @@
 #include <QObject>
 #include <QString>
 #include <QSaveFile>
-#include <QMutex>
+#include <QFile>
+#include <QAtomicInt>
 #include <QQueue>
 #include <QMap>
+#include <QHash>
+#include <QSet>
 #include <QUrl>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkRequest>
-#include <QtConcurrent/QtConcurrent>
-#include <QFuture>
-#include <QFutureWatcher>
-#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QCryptographicHash>
+
+#include <array>
+#include <memory>
 
 constexpr int REQUEST_TIMEOUT_MS = 20000;
-constexpr int MAX_RETRIES = 3;
+constexpr int MAX_RETRIES = 3;           // Transient failures: network errors, timeouts, 5xx
+constexpr int MAX_THROTTLE_RETRIES = 8;  // 429/503, the server is up but asks us to slow down
+constexpr int RETRY_BASE_DELAY_MS = 1000;
+constexpr int RETRY_MAX_DELAY_MS = 60000;
+constexpr int RETRY_AFTER_MAX_MS = 10 * 60 * 1000; // Upper bound on a server's Retry-After
+constexpr qint64 STREAM_BUFFER_SIZE = 64 * 1024; // Per-download read buffer, bounds memory regardless of file size
+
+constexpr int PROGRESS_INTERVAL_MS = 100; // Progress signals are coalesced to at most 10 per second
+
+constexpr int PRIORITY_AGING_MS = 10000;   // A queued download gains one priority class per interval waited; updates stop half a class ahead of a fresh install
+constexpr int RESERVED_INTERACTIVE_SLOTS = 1; // Slots background work may never take, kept for user actions
+
+// Adaptive per-host concurrency (AIMD)
+constexpr int HOST_MIN_CONCURRENCY = 1;
+constexpr int HOST_MAX_CONCURRENCY = 16;
+constexpr int HOST_INITIAL_CONCURRENCY = 4;
+constexpr int HOST_DECREASE_WINDOW_MS = 2000;     // Failures within one window only halve the limit once
+constexpr double HOST_LATENCY_CONGESTION = 2.0;   // Time to first byte above this multiple of the best seen holds growth
+constexpr double HOST_EWMA_WEIGHT = 0.2;
+
+// Scheduling classes, most urgent first
+enum class DownloadPriority {
+    Catalog,     // Catalog and metadata refreshes
+    Interactive, // Installs the user is waiting on
+    Background,  // Updates
+    Prefetch,
+    Count
+};
+
+// Receives a download's body while it is written to disk. Called on the network thread,
+// so implementations must hand the bytes off without blocking
+class DownloadSink {
+public:
+    virtual ~DownloadSink() = default;
 
-// Singleton API handler
+    // Start of every attempt's body; offset is how much of it the part file already holds
+    virtual void begin(const QString& partPath, qint64 offset) = 0;
+    virtual void write(const char* data, qint64 size) = 0;
+};
+
+// Per-download behaviour requested by the caller
+struct DownloadOptions {
+    bool revalidate = false; // Send stored ETag/Last-Modified validators, skip the transfer on 304
+    DownloadPriority priority = DownloadPriority::Interactive;
+    QByteArray expectedChecksum; // Hex digest (MD5/SHA-1/SHA-256/SHA-512 by length) verified before commit
+    std::shared_ptr<DownloadSink> sink; // Fed the body as it arrives; ignored when joining a transfer in flight
+};
+
+// Transfer accounting for one finished download
+struct DownloadStats {
+    QByteArray contentEncoding; // Empty when the body was sent uncompressed
+    qint64 wireBytes = 0;       // Body bytes as received, before decompression
+    qint64 decodedBytes = 0;    // Bytes after decompression, as written to disk
+    qint64 elapsedMs = 0;
+};
+
+// Adaptive concurrency state of one host, reported whenever its limit moves
+struct HostStats {
+    int limit = HOST_INITIAL_CONCURRENCY; // Transfers allowed in flight to this host
+    int inFlight = 0;
+    double throughput = 0;                // Bytes/s per transfer, exponentially weighted
+    double latencyMs = 0;                 // Time to first byte, exponentially weighted
+    double errorRate = 0;                 // Share of recent transfers that failed or were throttled
+    int throttled = 0;                    // 429/503 responses seen
+    QString decision;                     // Last adjustment and its reason
+};
+
+// Event-driven download engine. Every transfer is driven by reply signals on the thread
+// the client lives on (the network thread), so no thread is ever parked waiting on a reply.
+// Public methods are safe to call from any thread.
 class HttpClient : public QObject {
     Q_OBJECT
 
@@ -26,43 +98,151 @@ public:
     explicit HttpClient(int maxConcurrentDownloads = 3, QObject* parent = nullptr);
     ~HttpClient();
 
-    void addDownload(const QUrl& url, const QString& filePath);
-    void setMaxConcurrentDownloads(int max);
-    
+    void addDownload(const QUrl& url, const QString& filePath, const DownloadOptions& options = {});
+    void setMaxConcurrentDownloads(int max); // Cap across all hosts
+    void setConcurrencyBounds(int minPerHost, int maxPerHost);
+
     int activeDownloads() const;
 
+    // Hex digests of the lengths verification knows (MD5, SHA-1, SHA-256, SHA-512); anything else
+    // cannot be set as an expectedChecksum
+    static bool checksumAlgorithm(const QByteArray& checksum, QCryptographicHash::Algorithm* algorithm = nullptr);
+
 signals:
     void downloadProgress(const QString& filePath, qint64 bytesReceived, qint64 bytesTotal);
+    // Whole batch since the client was last idle; bytesTotal and etaMs are -1 while a size is unknown
+    void batchProgress(qint64 bytesReceived, qint64 bytesTotal, double bytesPerSecond, qint64 etaMs);
     void downloadFinished(const QString& filePath);
+    void downloadNotModified(const QString& filePath); // Existing file is still current, nothing was written
     void downloadFailed(const QString& filePath, const QString& errorString);
+    void downloadStats(const QString& filePath, const DownloadStats& stats);
+    void hostStatsChanged(const QString& host, const HostStats& stats);
     void allDownloadsFinished();
 
 private slots:
     void onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
+    void reportBatchProgress();
     void checkDownloadQueue();
 
 private:
     struct Download {
         QUrl url;
         QString filePath;
+        DownloadOptions options;
         int retries = 0;
+        int throttles = 0;
+        qint64 enqueuedAt = 0; // On m_clock, drives priority aging
+        qint64 notBefore = 0;  // On m_clock, backoff before the next attempt
+    };
+
+    enum class TransferOutcome {
+        Success,
+        Throttled, // 429/503, the server asks us to back off; retried after a host-wide cooldown
+        Failed,    // Network error, timeout or 5xx; retried with backoff
+        Fatal      // Not worth retrying and says nothing about the host's capacity, e.g. a 404
+    };
+
+    struct HostState {
+        HostStats stats;
+        int successes = 0;            // Clean completions since the limit last moved
+        double baselineLatencyMs = 0; // Best time to first byte seen
+        qint64 lastDecreaseAt = -1;
+        qint64 cooldownUntil = 0;     // On m_clock, nothing is sent to the host before then
+    };
+
+    // Cache validators persisted next to a revalidated file
+    struct Validators {
+        QByteArray etag;
+        QByteArray lastModified;
+    };
+
+    struct Decoder; // zlib state of a gzip/deflate body, see checkResponse()
+
+    // In-flight state of a single reply. The body streams into a .part sidecar next to the
+    // target and is renamed over it once complete; a journal beside the sidecar records the
+    // valid length and validator so a retry can resume with a Range request
+    struct Transfer {
+        Transfer(const Download& download, const QString& filePath)
+            : download(download), filePath(filePath), file(filePath + ".part") {}
+
+        Download download;
+        QString key;             // downloadKey(), later requests for the same key attach here
+        QString filePath;
+        QString host;
+        QFile file;
+        QByteArray buffer;
+        QElapsedTimer elapsed;
+        std::unique_ptr<QCryptographicHash> hash; // Fed every byte written, when a checksum is expected
+        std::unique_ptr<Decoder> decoder;         // Set while the body arrives compressed
+        Validators validators;   // Identify the partial content, sent back as If-Range
+        qint64 resumeOffset = 0; // Bytes already on disk when the request was sent
+        qint64 firstByteMs = -1;
+        qint64 bytesReceived = 0;  // Whole-file progress, including the resumed prefix
+        qint64 bytesTotal = -1;
+        qint64 lastProgressAt = -1;
+        int requests = 1;        // Callers served by this transfer
+        qint64 wireBytes = 0;
+        qint64 decodedBytes = 0;
+        bool resumable = false;
+        bool headersChecked = false;
+        bool checksumMismatch = false;
+        bool failed = false;
     };
 
     QNetworkAccessManager* m_networkManager;
     QMap<QString, QString> m_headers;
-    QQueue<Download> m_downloadQueue;
-    QMap<QNetworkReply*, Download> m_activeDownloads;
-    QList<QFutureWatcher<void>*> m_futureWatchers;
-    QThreadPool* m_threadPool;
+    std::array<QQueue<Download>, static_cast<int>(DownloadPriority::Count)> m_downloadQueues;
+    QElapsedTimer m_clock;
+    QTimer* m_wakeUpTimer; // Fires when the earliest backoff or host cooldown ends
+    QTimer* m_progressTimer;
+
+    // Batch progress, reset whenever the client goes idle
+    qint64 m_batchFinishedBytes = 0;
+    qint64 m_batchLastBytes = 0;
+    qint64 m_batchLastAt = 0;
+    double m_batchRate = 0;
+    QHash<QNetworkReply*, std::shared_ptr<Transfer>> m_activeDownloads;
+    QHash<QString, std::shared_ptr<Transfer>> m_activeByKey;
+    QSet<QString> m_activePaths; // Targets being written, a second writer has to wait
+
+    QHash<QString, HostState> m_hosts;
 
     int m_maxConcurrentDownloads = 3;
-    mutable QMutex m_qMutex;
+    int m_hostMinConcurrency = HOST_MIN_CONCURRENCY;
+    int m_hostMaxConcurrency = HOST_MAX_CONCURRENCY;
+    QAtomicInt m_activeCount = 0; // mirrors m_activeDownloads.size() for readers on other threads
 
     void initHeaders();
-    bool saveToDisk(const QString& filename, QIODevice* data);
+    QString resolveFilePath(const Download& download) const;
+    QString validatorsPath(const QString& filePath) const;
+    Validators loadValidators(const QString& filePath, const QUrl& url) const;
+    void saveValidators(const QString& filePath, QNetworkReply* reply) const;
+    QString journalPath(const QString& filePath) const;
+    qint64 loadJournal(const QString& filePath, const QUrl& url, Validators* validators) const;
+    void saveJournal(const Transfer* transfer) const;
+    void suspendPartial(Transfer* transfer) const;
+    void discardPartial(Transfer* transfer) const;
+    bool startChecksum(Transfer* transfer);
+    void checkResponse(QNetworkReply* reply, Transfer* transfer);
+    void writeChunk(QNetworkReply* reply, Transfer* transfer);
+    void writeBody(Transfer* transfer, const char* data, qint64 size);
+    bool saveToDisk(QNetworkReply* reply, Transfer* transfer);
+    void reportStats(QNetworkReply* reply, const Transfer* transfer);
+    QString downloadKey(const Download& download) const;
+    void enqueue(Download download);
+    void insertByWaitTime(const Download& download);
+    bool takeNextDownload(Download* next);
+    bool canDispatch(const Download& download, qint64 now) const;
+    qint64 nextReadyAt(qint64 now) const;
+    TransferOutcome classifyResult(QNetworkReply* reply, int statusCode) const;
+    qint64 retryAfterMs(QNetworkReply* reply) const;
+    qint64 backoffDelayMs(int attempt) const;
+    void adaptHostLimit(const Transfer* transfer, TransferOutcome outcome);
+    bool isQueueEmpty() const;
     void processDownloadQueue();
     void start(const Download& download);
-    void retryDownload(const Download& download);
+    void finishUnstarted();
+    void retryDownload(const Download& download, TransferOutcome outcome, qint64 retryAfter);
     void handleDownloadResult(QNetworkReply* reply);
 
     QNetworkRequest createRequest(const QUrl& url) const;
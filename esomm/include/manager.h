@@ -2,35 +2,50 @@
 
 #include "ModType.h"
 #include "http_client.h"
+#include "archive_cache.h"
+#include "archive_extractor.h"
+#include "catalog_store.h"
 #include "pathing.h"
 
 #include <QObject>
 #include <QList>
 #include <QDir>
+#include <QThread>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QQueue>
+#include <QSet>
+#include <atomic>
 #include <memory>
 
+constexpr int MAX_CONCURRENT_EXTRACTIONS = 2; // Archives extracted at once, each already spread over all cores
+
 class Manager : public QObject {
     Q_OBJECT
 
 public:
     explicit Manager(QObject* parent = nullptr);
+    ~Manager();
 
     // Installed mods
-    void scanInstalledMods();
+    void scanInstalledMods(); // Runs in the background, installedModsChanged follows
     bool uninstallMod(const QString& id);
     QList<ModInfo> getInstalledMods() const;
-    ModInfo* getInstalledMod(const QString& id);
+    const ModInfo* getInstalledMod(const QString& id) const;
 
     // Available mods
     void loadAvailableMods();
     QList<ModInfo> getAvailableMods() const;
     QList<ModInfo> getModsWithUpdates() const;
-    ModInfo* getAvailableMod(const QString& id);
+    const ModInfo* getAvailableMod(const QString& id) const;
 
     bool installMod(const QString& id);
     bool updateMod(const QString& id);
+    int updateMods(const QStringList& ids); // Returns how many updates were started
+    int updateAllMods();
+    bool isUpdatingBatch() const;
+
+    void setArchiveCacheLimit(qint64 maxBytes);
 
 signals:
     void installedModsChanged();
@@ -38,23 +53,113 @@ signals:
     void modActionStarted(const QString& action, const QString& modTitle);
     void modActionCompleted(const QString& action, const QString& modTitle, bool success);
     void availableModsLoaded();
+    void modsUpdated(const QStringList& updatedTitles, const QStringList& failedTitles); // End of an updateMods() batch
+    // Catalog entries a load added, dropped or revised, by mod id. Only emitted when non-empty
+    void catalogModsAdded(const QStringList& ids);
+    void catalogModsRemoved(const QStringList& ids);
+    void catalogModsChanged(const QStringList& ids);
+    // Files written and bytes left untouched by an update that only rewrote what changed
+    void deltaUpdateApplied(const QString& modTitle, int changedFiles, int removedFiles, qint64 bytesWritten, qint64 bytesSaved);
 
 private:
     Pathing* m_pathing;
     QDir m_addonsDir;
 
-    QHash<QString, ModInfo*> installedMods;
-    QList<ModInfo> mods;
+    CatalogStore mods;
+    bool m_catalogLoaded = false; // From the snapshot or master.json, not just the installed cache
     HttpClient* httpClient;
+    QThread* m_networkThread;
+
+    // Archive downloads in flight, keyed by their target path. Mods shipping the same archive share
+    // one download: the first one asked for leads it, the others wait on the same path
+    struct PendingArchive {
+        QString modId;
+        QString modTitle;
+        QUrl downloadUrl;
+        DownloadPriority priority = DownloadPriority::Interactive; // Most urgent asked for, on the lead
+        QString checksum;    // Empty when the archive is not kept in the cache
+        QString action;      // "install" or "update", echoed in modActionCompleted
+        QString archivePath;
+        QString replacePath; // Install folder of the version being updated
+        std::shared_ptr<ArchiveExtractor> extractor;
+        bool streamed = false; // Extracted while downloading rather than from the finished file
+        bool delta = false;    // Only rewrite files that differ from the installed copy
+    };
+    ArchiveCache m_archiveCache;
+    QHash<QString, QList<PendingArchive>> m_pendingArchives;
+    QQueue<PendingArchive> m_extractionQueue;
+    int m_activeExtractions = 0;
+    // Mod ids from startInstall until finishInstall, with the extractor once one exists
+    QHash<QString, std::shared_ptr<ArchiveExtractor>> m_installing;
+
+    struct UpdateBatch {
+        QSet<QString> pending; // Mod ids still downloading or extracting
+        QStringList updated;
+        QStringList failed;
+    };
+    UpdateBatch m_updateBatch;
+
+    // An AddOns subdirectory as read from disk
+    struct InstalledFolder {
+        QString name;
+        QString path;
+        int addOnVersion = -1; // From its manifest, -1 if unknown
+    };
+
+    QHash<QString, InstalledFolder> m_installedFolders; // Last scan, by folder name
+    quint64 m_scanGeneration = 0; // Bumped per rescan, older results are dropped
+
+    // Result of a background catalog load
+    struct CatalogLoad {
+        bool ok = false;
+        bool fromSnapshot = false;
+        bool scanned = false; // AddOns was scanned along with it
+        QString error;
+        QList<ModInfo> mods;
+        QList<InstalledFolder> installed;
+    };
+    quint64 m_catalogGeneration = 0; // Bumped per load, older results are dropped
+    std::shared_ptr<std::atomic<bool>> m_catalogCancel; // Of the load in flight
+
+    int installedRow(const QString& id) const;
+    bool startInstall(const ModInfo& mod, const QString& action, const QString& replacePath, DownloadPriority priority);
+    void finishUpdateBatch();
+    bool hasNewerVersion(const ModInfo& mod, const InstalledFolder& folder) const;
+    static QList<InstalledFolder> scanAddonsDir(const QString& addonsPath);
+    void applyInstalledScan(const QList<InstalledFolder>& folders);
+    int catalogRowForFolder(const QString& name) const;
+    bool matchInstalledFolder(int row);
+    void startCatalogLoad(const QString& filePath, bool fromSnapshot);
+    void applyCatalog(CatalogLoad load);
+    bool isCatalogCurrent(const QString& masterJsonPath) const;
+    void raisePendingDownload(PendingArchive& lead, DownloadPriority priority);
+    void extractArchive(PendingArchive pending);
+    QString stagingRoot() const;
+    void recoverStaging();
+    QString newStagingPath(const QString& modId) const;
+    void finishInstall(const PendingArchive& pending, const ArchiveExtractor::Result& result);
+    bool commitStaged(const ArchiveExtractor::Result& result, const QString& retiredPath);
+    bool commitDelta(const ArchiveExtractor::Result& result, const QString& retiredPath);
+
+    // One rename of a commit, journaled so an interrupted commit can be undone at startup
+    struct CommitMove {
+        QString from;
+        QString to;
+    };
+    bool applyMoves(const QString& stagingPath, const QString& kind, const QList<CommitMove>& moves);
+    static QString commitJournalPath(const QString& stagingPath);
+    static bool writeCommitJournal(const QString& stagingPath, const QString& kind, const QList<CommitMove>& moves, bool committed);
+    static bool readCommitJournal(const QString& path, QList<CommitMove>* moves, bool* committed);
+    static bool undoMoves(const QList<CommitMove>& moves);
 
     void saveInstalledModsCache();
     void loadInstalledModsCache();
     QJsonObject modToJson(const ModInfo& mod);
     ModInfo jsonToMod(const QJsonObject& modObject);
     QString getInstalledCachePath() const;
+    QString getCatalogSnapshotPath() const;
 
     ModInfo parseInstalledMod(const QDir& dir);
-    ModInfo parseAvailableMod(const QJsonObject& obj);
     void parseAvailableMods(const QString& filePath);
     //void updateModComparisons();
 };
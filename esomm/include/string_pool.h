@@ -0,0 +1,42 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+#include <array>
+#include <atomic>
+
+constexpr int STRING_POOL_SHARDS = 16; // Independent locks, parallel decoders rarely contend
+
+// Interning pool for catalog field values that repeat across thousands of entries (authors,
+// API versions, shared library names). Equal values come back as copies of one implicitly
+// shared QString, so they cost a single allocation. Lookups are keyed on the raw UTF-8 bytes
+// and a hit skips decoding altogether.
+//
+// Thread-safe. The pool only has to live as long as the load using it; the strings it handed
+// out stay shared after it is gone.
+class StringPool {
+public:
+    struct Stats {
+        qint64 lookups = 0;
+        qint64 hits = 0;
+        qint64 bytesSaved = 0; // UTF-16 payload of every hit, allocation overhead not included
+        int distinct = 0;
+    };
+
+    QString intern(const char* utf8, qsizetype size);
+    Stats stats() const;
+
+private:
+    struct Shard {
+        mutable QMutex mutex;
+        QHash<QByteArray, QString> strings;
+    };
+
+    std::array<Shard, STRING_POOL_SHARDS> m_shards;
+    std::atomic<qint64> m_lookups { 0 };
+    std::atomic<qint64> m_hits { 0 };
+    std::atomic<qint64> m_bytesSaved { 0 };
+};
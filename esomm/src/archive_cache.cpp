@@ -0,0 +1,182 @@
+#include "archive_cache.h"
+#include "http_client.h"
+#include "logger.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+
+ArchiveCache::ArchiveCache(const QString& rootPath, qint64 maxBytes)
+    : m_rootPath(rootPath), m_maxBytes(maxBytes) {
+
+    QDir dir(m_rootPath);
+    if (!dir.exists()) {
+        dir.mkpath(".");
+    }
+
+    loadIndex();
+}
+
+// Checksums become file names and are verified on download, so only hex digests HttpClient can
+// check are accepted; mods with any other checksum are downloaded uncached and unverified
+bool ArchiveCache::isValidKey(const QString& checksum) {
+    return HttpClient::checksumAlgorithm(checksum.toLatin1());
+}
+
+QString ArchiveCache::pathFor(const QString& checksum) const {
+    return m_rootPath + "/" + checksum.toLower() + ".zip";
+}
+
+bool ArchiveCache::contains(const QString& checksum) {
+    const QString key = checksum.toLower();
+    if (!m_entries.contains(key)) {
+        return false;
+    }
+
+    // Files removed behind our back are forgotten
+    if (!QFileInfo::exists(pathFor(key))) {
+        m_totalBytes -= m_entries.take(key).size;
+        saveIndex();
+        return false;
+    }
+    return true;
+}
+
+// Registers an archive that was just written to pathFor(checksum)
+void ArchiveCache::insert(const QString& checksum) {
+    const QString key = checksum.toLower();
+    const QFileInfo info(pathFor(key));
+    if (!info.exists()) {
+        qCWarning(loggerCategory) << "Archive missing from cache directory:" << info.filePath();
+        return;
+    }
+
+    m_totalBytes -= m_entries.value(key).size;
+    m_entries.insert(key, { info.size(), QDateTime::currentMSecsSinceEpoch() });
+    m_totalBytes += info.size();
+
+    evict(key);
+    saveIndex();
+}
+
+void ArchiveCache::touch(const QString& checksum) {
+    auto it = m_entries.find(checksum.toLower());
+    if (it == m_entries.end()) return;
+
+    it->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    saveIndex();
+}
+
+void ArchiveCache::remove(const QString& checksum) {
+    const QString key = checksum.toLower();
+    QFile::remove(pathFor(key));
+
+    if (m_entries.contains(key)) {
+        m_totalBytes -= m_entries.take(key).size;
+        saveIndex();
+    }
+}
+
+void ArchiveCache::pin(const QString& checksum) {
+    m_pins[checksum.toLower()]++;
+}
+
+// Evictions held back by the pin happen now
+void ArchiveCache::unpin(const QString& checksum) {
+    const QString key = checksum.toLower();
+    auto it = m_pins.find(key);
+    if (it == m_pins.end()) return;
+
+    if (--it.value() == 0) {
+        m_pins.erase(it);
+        if (m_totalBytes > m_maxBytes) {
+            evict();
+            saveIndex();
+        }
+    }
+}
+
+void ArchiveCache::setMaxBytes(qint64 maxBytes) {
+    m_maxBytes = qMax<qint64>(0, maxBytes);
+    evict();
+    saveIndex();
+}
+
+qint64 ArchiveCache::maxBytes() const {
+    return m_maxBytes;
+}
+
+qint64 ArchiveCache::totalBytes() const {
+    return m_totalBytes;
+}
+
+QString ArchiveCache::indexPath() const {
+    return m_rootPath + "/index.json";
+}
+
+// The index only carries recency; sizes and presence always come from the directory itself
+void ArchiveCache::loadIndex() {
+    QJsonObject index;
+    QFile file(indexPath());
+    if (file.open(QIODevice::ReadOnly)) {
+        index = QJsonDocument::fromJson(file.readAll()).object();
+    }
+
+    const QFileInfoList archives = QDir(m_rootPath).entryInfoList({ "*.zip" }, QDir::Files);
+    for (const QFileInfo& archive : archives) {
+        const QString key = archive.completeBaseName();
+        if (!isValidKey(key)) continue;
+
+        const qint64 lastUsed = index.contains(key)
+            ? index[key].toInteger()
+            : archive.lastModified().toMSecsSinceEpoch();
+
+        m_entries.insert(key, { archive.size(), lastUsed });
+        m_totalBytes += archive.size();
+    }
+
+    qCInfo(loggerCategory) << "Archive cache holds" << m_entries.size() << "archives," << m_totalBytes << "bytes";
+    evict();
+}
+
+void ArchiveCache::saveIndex() const {
+    QJsonObject index;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        index[it.key()] = it->lastUsed;
+    }
+
+    QSaveFile file(indexPath());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(loggerCategory) << "Failed to save archive cache index:" << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+    file.commit();
+}
+
+// Drops least recently used archives until the store fits its cap, never the one just stored or a
+// pinned one. The store may stay over its cap until the pins are released
+void ArchiveCache::evict(const QString& keep) {
+    if (m_totalBytes <= m_maxBytes) return;
+
+    QList<QString> keys = m_entries.keys();
+    std::sort(keys.begin(), keys.end(), [this](const QString& a, const QString& b) {
+        return m_entries[a].lastUsed < m_entries[b].lastUsed;
+    });
+
+    for (const QString& key : keys) {
+        if (m_totalBytes <= m_maxBytes) break;
+        if (key == keep || m_pins.contains(key)) continue;
+
+        if (QFile::remove(pathFor(key)) || !QFileInfo::exists(pathFor(key))) {
+            m_totalBytes -= m_entries.take(key).size;
+            qCInfo(loggerCategory) << "Evicted cached archive" << key;
+        }
+    }
+}
@@ -0,0 +1,930 @@
+#include "archive_extractor.h"
+#include "logger.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QThread>
+#include <QDirIterator>
+#include <QtEndian>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <algorithm>
+#include <limits>
+
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#else
+#include <QtZlib/zlib.h>
+#endif
+
+// Zip record signatures and sizes, see APPNOTE.TXT
+constexpr quint32 ZIP_LOCAL_HEADER = 0x04034b50;
+constexpr quint32 ZIP_DATA_DESCRIPTOR = 0x08074b50;
+constexpr quint32 ZIP_CENTRAL_HEADER = 0x02014b50;
+constexpr quint32 ZIP_END_OF_CENTRAL_DIRECTORY = 0x06054b50;
+constexpr quint32 ZIP64_END_OF_CENTRAL_DIRECTORY = 0x06064b50;
+constexpr quint32 ZIP64_END_LOCATOR = 0x07064b50;
+constexpr int ZIP_LOCAL_HEADER_SIZE = 30;
+constexpr int ZIP_CENTRAL_HEADER_SIZE = 46;
+constexpr int ZIP_END_SIZE = 22;
+constexpr int ZIP64_END_LOCATOR_SIZE = 20;
+constexpr int ZIP64_END_SIZE = 56;
+constexpr quint16 ZIP_ZIP64_EXTRA = 0x0001;
+constexpr quint16 ZIP_STORED = 0;
+constexpr quint16 ZIP_DEFLATED = 8;
+constexpr quint16 ZIP_FLAG_ENCRYPTED = 0x0001;
+constexpr quint16 ZIP_FLAG_DESCRIPTOR = 0x0008;
+constexpr quint16 ZIP_FLAG_UTF8 = 0x0800;
+
+// Entry writes of parallel extractions. Separate from the global pool, whose task is waiting on them
+Q_GLOBAL_STATIC(QThreadPool, extractionPool)
+
+// The zip64 extra field holds only the sizes that overflowed their 32-bit slot, in this order
+static bool readZip64Extra(const char* extra, int length, qint64* size, qint64* compressedSize, qint64* offset) {
+    const char* end = extra + length;
+    while (end - extra >= 4) {
+        const quint16 id = qFromLittleEndian<quint16>(extra);
+        const char* field = extra + 4;
+        const char* fieldEnd = field + qFromLittleEndian<quint16>(extra + 2);
+        if (fieldEnd > end) break;
+
+        if (id == ZIP_ZIP64_EXTRA) {
+            for (qint64* value : { size, compressedSize, offset }) {
+                if (value && *value == 0xFFFFFFFF && fieldEnd - field >= 8) {
+                    *value = qFromLittleEndian<quint64>(field);
+                    field += 8;
+                }
+            }
+            return true;
+        }
+        extra = fieldEnd;
+    }
+    return false;
+}
+
+bool ArchiveExtractor::splitEntryPath(const QString& name, QStringList* parts) {
+    parts->clear();
+    if (name.startsWith('/') || name.contains('\\')) return false;
+
+    const QStringList segments = name.split('/', Qt::SkipEmptyParts);
+    for (const QString& segment : segments) {
+        if (!isPlainSegment(segment)) return false;
+    }
+    *parts = segments;
+    return !parts->isEmpty();
+}
+
+// A name that means the same folder on every platform
+bool ArchiveExtractor::isPlainSegment(const QString& segment) {
+    if (segment.isEmpty() || segment == "." || segment == ".." || segment.contains(':')) return false;
+    if (segment.endsWith('.') || segment.endsWith(' ')) return false;
+
+    // CON, NUL, COM1... name a device on Windows, with or without an extension
+    const QString stem = segment.section('.', 0, 0).trimmed().toUpper();
+    if (stem == "CON" || stem == "PRN" || stem == "AUX" || stem == "NUL") return false;
+    if (stem.size() == 4 && (stem.startsWith("COM") || stem.startsWith("LPT")) && stem[3].isDigit()) return false;
+    return true;
+}
+
+// Archive names and live files are matched cleaned, and the way the file system compares them
+static QString pathKey(const QString& relativePath) {
+#ifdef Q_OS_WIN
+    return QDir::cleanPath(relativePath).toLower();
+#else
+    return QDir::cleanPath(relativePath);
+#endif
+}
+
+struct ArchiveExtractor::Inflater {
+    Inflater() {
+        output.resize(EXTRACT_BUFFER_SIZE);
+        ok = inflateInit2(&stream, -MAX_WBITS) == Z_OK; // Raw deflate, zip entries carry no zlib header
+    }
+    ~Inflater() {
+        if (ok) inflateEnd(&stream);
+    }
+
+    z_stream stream = {};
+    QByteArray output;
+    bool ok = false;
+};
+
+ArchiveExtractor::ArchiveExtractor(const QString& stagingPath)
+    : m_stagingPath(stagingPath), m_inflater(std::make_unique<Inflater>()) {
+
+    QDir().mkpath(m_stagingPath);
+}
+
+ArchiveExtractor::~ArchiveExtractor() = default;
+
+// The body restarting from zero means the server sent a different representation, so everything
+// extracted so far is thrown away. A resume that overlaps what was already fed skips the overlap;
+// one that starts past it (a part file from an earlier session) replays the missing prefix
+void ArchiveExtractor::begin(const QString& partPath, qint64 offset) {
+    if (m_overflowed) return;
+
+    if (offset == 0) {
+        if (m_received > 0) {
+            Input input;
+            input.reset = true;
+            push(std::move(input));
+        }
+        m_received = 0;
+        m_skip = 0;
+        return;
+    }
+
+    if (offset <= m_received) {
+        m_skip = m_received - offset;
+        return;
+    }
+
+    // The missing prefix is already on disk; the worker reads it, the network thread only queues the range
+    m_skip = 0;
+    Input input;
+    input.partPath = partPath;
+    input.partFrom = m_received;
+    input.partTo = offset;
+    m_received = offset;
+    push(std::move(input));
+}
+
+void ArchiveExtractor::write(const char* data, qint64 size) {
+    if (m_overflowed) return;
+
+    const qint64 skipped = qMin(m_skip, size);
+    m_skip -= skipped;
+    if (size <= skipped) return;
+
+    bool behind;
+    {
+        QMutexLocker lock(&m_mutex);
+        behind = m_queuedBytes + size - skipped > EXTRACT_MAX_QUEUED_BYTES;
+    }
+    if (behind) {
+        overflow();
+        return;
+    }
+
+    Input input;
+    input.data = QByteArray(data + skipped, size - skipped);
+    m_received += input.data.size();
+    push(std::move(input));
+}
+
+void ArchiveExtractor::setDeltaBase(const QString& liveRoot) {
+    m_deltaBase = liveRoot;
+}
+
+void ArchiveExtractor::extractFile(const QString& archivePath) {
+    Input input;
+    input.filePath = archivePath;
+    push(std::move(input));
+}
+
+void ArchiveExtractor::finish(QObject* context, std::function<void(const Result&)> done) {
+    QMutexLocker lock(&m_mutex);
+    if (m_closed) return;
+
+    m_closed = true;
+    m_context = context;
+    m_done = std::move(done);
+    scheduleDrain();
+}
+
+void ArchiveExtractor::cancel() {
+    QMutexLocker lock(&m_mutex);
+    m_cancelled = true;
+    m_closed = true;
+    m_input.clear();
+    m_queuedBytes = 0;
+    m_done = nullptr;
+
+    // A running drain task cleans up when it notices; otherwise nothing else touches the files
+    if (!m_draining) {
+        m_file.close();
+        QDir(m_stagingPath).removeRecursively();
+    }
+}
+
+// Input is copied into the queue, the network thread never waits for the worker. Inflating
+// outpaces any realistic download, so the queue stays short in practice; see overflow() for when
+// it does not.
+void ArchiveExtractor::push(Input input) {
+    QMutexLocker lock(&m_mutex);
+    if (m_closed) return;
+
+    m_queuedBytes += input.data.size();
+    m_input.enqueue(std::move(input));
+    scheduleDrain();
+}
+
+// The worker fell EXTRACT_MAX_QUEUED_BYTES behind the network (a slow disk, a busy pool). Rather
+// than buffer the rest of the archive in memory, the queued input is dropped and the extraction
+// fails; the owner then extracts the finished download from disk
+void ArchiveExtractor::overflow() {
+    qCInfo(loggerCategory) << "Extraction into" << m_stagingPath << "fell behind the download, giving up on streaming it";
+    m_overflowed = true;
+
+    QMutexLocker lock(&m_mutex);
+    if (m_closed) return;
+
+    m_input.clear();
+    m_queuedBytes = 0;
+    Input input;
+    input.error = "Extraction fell behind the download";
+    m_input.enqueue(std::move(input));
+    scheduleDrain();
+}
+
+// Expects m_mutex to be held
+void ArchiveExtractor::scheduleDrain() {
+    if (m_draining) return;
+
+    m_draining = true;
+    QThreadPool::globalInstance()->start([self = shared_from_this()]() {
+        self->drain();
+    });
+}
+
+bool ArchiveExtractor::isCancelled() {
+    QMutexLocker lock(&m_mutex);
+    return m_cancelled;
+}
+
+void ArchiveExtractor::drain() {
+    for (;;) {
+        Input input;
+        QObject* context = nullptr;
+        std::function<void(const Result&)> done;
+        {
+            QMutexLocker lock(&m_mutex);
+            if (m_cancelled) {
+                m_draining = false;
+                break;
+            }
+            if (m_input.isEmpty()) {
+                m_draining = false;
+                if (!m_closed || !m_done) return;
+
+                context = m_context.data();
+                done = std::move(m_done);
+                m_done = nullptr;
+            } else {
+                input = m_input.dequeue();
+                m_queuedBytes -= input.data.size();
+            }
+        }
+
+        if (done) {
+            complete(context, done);
+            return;
+        }
+
+        if (input.reset) {
+            reset();
+        } else if (!input.error.isEmpty()) {
+            fail(input.error);
+        } else if (!input.filePath.isEmpty()) {
+            extractArchive(input.filePath);
+        } else if (!input.partPath.isEmpty()) {
+            consumePart(input);
+        } else {
+            consume(input.data);
+        }
+    }
+
+    m_file.close();
+    QDir(m_stagingPath).removeRecursively();
+}
+
+void ArchiveExtractor::complete(QObject* context, const std::function<void(const Result&)>& done) {
+    m_file.close();
+
+    Result result;
+    result.stagingPath = m_stagingPath;
+    result.files = m_files;
+    result.bytesWritten = m_bytesWritten;
+    result.delta = !m_deltaBase.isEmpty();
+    result.changedFiles = m_changedFiles;
+    result.removedFiles = m_removedFiles;
+    result.unchangedFiles = m_unchangedFiles;
+    result.bytesSkipped = m_bytesSkipped;
+
+    if (m_state == State::Done) {
+        result.success = true;
+        result.topLevelEntries = m_topLevel.values();
+        std::sort(result.topLevelEntries.begin(), result.topLevelEntries.end());
+    } else {
+        result.error = m_state == State::Failed ? m_error : "Archive ended before its central directory";
+        result.corrupt = m_state == State::Failed ? m_corrupt : true;
+        QDir(m_stagingPath).removeRecursively();
+    }
+
+    if (context) {
+        QMetaObject::invokeMethod(context, [done, result]() {
+            done(result);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void ArchiveExtractor::reset() {
+    m_file.close();
+    inflateReset(&m_inflater->stream);
+    QDir(m_stagingPath).removeRecursively();
+    QDir().mkpath(m_stagingPath);
+
+    m_state = State::Header;
+    m_error.clear();
+    m_corrupt = false;
+    m_pending.clear();
+    m_entry = Entry();
+    m_topLevel.clear();
+    m_files = 0;
+    m_bytesWritten = 0;
+    m_changedFiles.clear();
+    m_removedFiles.clear();
+    m_unchangedFiles = 0;
+    m_bytesSkipped = 0;
+}
+
+void ArchiveExtractor::consume(const QByteArray& data) {
+    if (m_state == State::Done || m_state == State::Failed) return;
+
+    m_pending.append(data);
+    parse();
+}
+
+// Replays a range of a part file through the streaming parser, one buffer at a time
+void ArchiveExtractor::consumePart(const Input& input) {
+    QFile part(input.partPath);
+    if (!part.open(QIODevice::ReadOnly) || !part.seek(input.partFrom)) {
+        fail("Could not read the resumed part of " + input.partPath);
+        return;
+    }
+
+    qint64 position = input.partFrom;
+    while (position < input.partTo && m_state != State::Done && m_state != State::Failed) {
+        if (isCancelled()) return;
+
+        const QByteArray data = part.read(qMin(EXTRACT_BUFFER_SIZE, input.partTo - position));
+        if (data.isEmpty()) {
+            fail("Could not read the resumed part of " + input.partPath);
+            return;
+        }
+        position += data.size();
+        consume(data);
+    }
+}
+
+// A finished archive lists every entry in its central directory, so entries can be inflated
+// independently: directories are created up front, then files are spread over the
+// extraction pool, largest first so one big file does not finish last on its own
+void ArchiveExtractor::extractArchive(const QString& filePath) {
+    reset();
+
+    QFile archive(filePath);
+    if (!archive.open(QIODevice::ReadOnly)) {
+        fail("Failed to open archive " + filePath + ": " + archive.errorString());
+        return;
+    }
+
+    QList<ZipEntry> entries;
+    QString error;
+    bool corrupt = false;
+    if (!readCentralDirectory(archive, &entries, &error, &corrupt)) {
+        fail(error, corrupt);
+        return;
+    }
+    archive.close();
+
+    QList<ZipEntry> files;
+    QSet<QString> targets;
+    for (ZipEntry& entry : entries) {
+        QStringList parts;
+        if (!splitEntryPath(entry.name, &parts)) {
+            fail("Unsafe path in archive: " + entry.name);
+            return;
+        }
+        if (entry.method != ZIP_STORED && entry.method != ZIP_DEFLATED) {
+            fail(QString("Unsupported compression method %1 for %2").arg(entry.method).arg(entry.name));
+            return;
+        }
+
+        m_topLevel.insert(parts.first());
+        entry.relativePath = parts.join('/');
+        entry.targetPath = m_stagingPath + "/" + entry.relativePath;
+
+        if (entry.name.endsWith('/')) {
+            if (m_deltaBase.isEmpty()) {
+                QDir().mkpath(entry.targetPath);
+            }
+        } else if (!targets.contains(pathKey(entry.relativePath))) { // Duplicate names keep the first entry
+            targets.insert(pathKey(entry.relativePath));
+            files.append(entry);
+        }
+    }
+
+    std::sort(files.begin(), files.end(), [](const ZipEntry& a, const ZipEntry& b) {
+        return a.compressedSize > b.compressedSize;
+    });
+
+    if (extractionPool()->maxThreadCount() != QThread::idealThreadCount()) {
+        extractionPool()->setMaxThreadCount(QThread::idealThreadCount());
+    }
+
+    QMutex mutex; // Guards firstError, firstCorrupt and m_changedFiles
+    QString firstError;
+    bool firstCorrupt = false;
+    QAtomicInt failed = 0;
+    QAtomicInt unchanged = 0;
+    QAtomicInteger<qint64> written = 0;
+    QAtomicInteger<qint64> skipped = 0;
+
+    // Comparing against the live copy only reads, and runs in parallel like the writes
+    // Cancelling skips the entries not started yet, so shutdown only waits for the ones in flight
+    QtConcurrent::blockingMap(extractionPool(), files, [&](const ZipEntry& entry) {
+        if (failed.loadRelaxed() || isCancelled()) return;
+
+        if (!m_deltaBase.isEmpty()) {
+            if (matchesFile(m_deltaBase + "/" + entry.relativePath, entry.size, entry.crc)) {
+                unchanged.ref();
+                skipped.fetchAndAddRelaxed(entry.size);
+                return;
+            }
+            QMutexLocker lock(&mutex);
+            m_changedFiles.append(entry.relativePath);
+        }
+
+        qint64 bytes = 0;
+        QString entryError;
+        bool entryCorrupt = false;
+        QDir().mkpath(QFileInfo(entry.targetPath).absolutePath());
+        if (extractEntry(filePath, entry, &bytes, &entryError, &entryCorrupt)) {
+            written.fetchAndAddRelaxed(bytes);
+        } else {
+            QMutexLocker lock(&mutex);
+            if (firstError.isEmpty()) {
+                firstError = entryError;
+                firstCorrupt = entryCorrupt;
+            }
+            failed.storeRelaxed(1);
+        }
+    });
+
+    if (!firstError.isEmpty()) {
+        fail(firstError, firstCorrupt);
+        return;
+    }
+
+    if (!m_deltaBase.isEmpty()) {
+        if (!findRemovedFiles(targets)) return;
+        std::sort(m_changedFiles.begin(), m_changedFiles.end());
+    }
+
+    m_files = files.size();
+    m_bytesWritten = written.loadRelaxed();
+    m_unchangedFiles = unchanged.loadRelaxed();
+    m_bytesSkipped = skipped.loadRelaxed();
+    m_state = State::Done;
+}
+
+// Live files under the archive's top-level folders that the archive no longer has. Each folder is
+// walked under the live root, so one that is not a plain name would reach past the addon
+bool ArchiveExtractor::findRemovedFiles(const QSet<QString>& archiveFiles) {
+    const QDir base(m_deltaBase);
+
+    for (const QString& folder : std::as_const(m_topLevel)) {
+        if (!isPlainSegment(folder)) {
+            fail("Unsafe top-level entry in archive: \"" + folder + "\"");
+            return false;
+        }
+    }
+
+    for (const QString& folder : std::as_const(m_topLevel)) {
+        QDirIterator it(base.absoluteFilePath(folder), QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString relativePath = base.relativeFilePath(it.next());
+            if (!archiveFiles.contains(pathKey(relativePath))) {
+                m_removedFiles.append(relativePath);
+            }
+        }
+    }
+    std::sort(m_removedFiles.begin(), m_removedFiles.end());
+    return true;
+}
+
+bool ArchiveExtractor::matchesFile(const QString& filePath, qint64 size, quint32 crc) {
+    QFile file(filePath);
+    if (file.size() != size || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray buffer(EXTRACT_BUFFER_SIZE, Qt::Uninitialized);
+    quint32 actual = crc32(0L, Z_NULL, 0);
+    qint64 bytesRead;
+    while ((bytesRead = file.read(buffer.data(), buffer.size())) > 0) {
+        actual = crc32(actual, reinterpret_cast<const Bytef*>(buffer.constData()), uInt(bytesRead));
+    }
+    return bytesRead == 0 && actual == crc;
+}
+
+bool ArchiveExtractor::readCentralDirectory(QFile& archive, QList<ZipEntry>* entries, QString* error, bool* corrupt) {
+    // The end record is the last thing in the file, followed only by a comment of up to 64 KiB
+    const qint64 fileSize = archive.size();
+    const qint64 tailSize = qMin<qint64>(fileSize, ZIP_END_SIZE + 0xFFFF);
+    archive.seek(fileSize - tailSize);
+    const QByteArray tail = archive.read(tailSize);
+
+    qsizetype endAt = -1;
+    for (qsizetype i = tail.size() - ZIP_END_SIZE; i >= 0; i--) {
+        if (qFromLittleEndian<quint32>(tail.constData() + i) == ZIP_END_OF_CENTRAL_DIRECTORY) {
+            endAt = i;
+            break;
+        }
+    }
+    if (endAt < 0) {
+        *error = "Not a zip archive, no end of central directory";
+        *corrupt = true;
+        return false;
+    }
+
+    const char* end = tail.constData() + endAt;
+    qint64 count = qFromLittleEndian<quint16>(end + 10);
+    qint64 directorySize = qFromLittleEndian<quint32>(end + 12);
+    qint64 directoryOffset = qFromLittleEndian<quint32>(end + 16);
+
+    // Saturated fields mean the real values are in the zip64 end record, found through its locator
+    if (count == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF) {
+        archive.seek(fileSize - tailSize + endAt - ZIP64_END_LOCATOR_SIZE);
+        const QByteArray locator = archive.read(ZIP64_END_LOCATOR_SIZE);
+        if (locator.size() != ZIP64_END_LOCATOR_SIZE || qFromLittleEndian<quint32>(locator.constData()) != ZIP64_END_LOCATOR) {
+            *error = "Corrupt zip64 end of central directory locator";
+            *corrupt = true;
+            return false;
+        }
+
+        archive.seek(qFromLittleEndian<quint64>(locator.constData() + 8));
+        const QByteArray record = archive.read(ZIP64_END_SIZE);
+        if (record.size() != ZIP64_END_SIZE || qFromLittleEndian<quint32>(record.constData()) != ZIP64_END_OF_CENTRAL_DIRECTORY) {
+            *error = "Corrupt zip64 end of central directory";
+            *corrupt = true;
+            return false;
+        }
+        count = qFromLittleEndian<quint64>(record.constData() + 32);
+        directorySize = qFromLittleEndian<quint64>(record.constData() + 40);
+        directoryOffset = qFromLittleEndian<quint64>(record.constData() + 48);
+    }
+
+    // Compared without adding the two, zip64 values are large enough to wrap the sum
+    if (directoryOffset < 0 || directorySize < 0 || directorySize > fileSize || directoryOffset > fileSize - directorySize
+        || !archive.seek(directoryOffset)) {
+        *error = "Central directory lies outside the archive";
+        *corrupt = true;
+        return false;
+    }
+    const QByteArray directory = archive.read(directorySize);
+    if (directory.size() != directorySize) {
+        *error = "Truncated central directory";
+        *corrupt = true;
+        return false;
+    }
+
+    qsizetype pos = 0;
+    for (qint64 i = 0; i < count; i++) {
+        const char* header = directory.constData() + pos;
+        if (directory.size() - pos < ZIP_CENTRAL_HEADER_SIZE || qFromLittleEndian<quint32>(header) != ZIP_CENTRAL_HEADER) {
+            *error = "Corrupt central directory";
+            *corrupt = true;
+            return false;
+        }
+
+        const quint16 flags = qFromLittleEndian<quint16>(header + 8);
+        const int nameLength = qFromLittleEndian<quint16>(header + 28);
+        const int extraLength = qFromLittleEndian<quint16>(header + 30);
+        const int commentLength = qFromLittleEndian<quint16>(header + 32);
+        const qsizetype recordSize = ZIP_CENTRAL_HEADER_SIZE + nameLength + extraLength + commentLength;
+        if (directory.size() - pos < recordSize) {
+            *error = "Corrupt central directory";
+            *corrupt = true;
+            return false;
+        }
+
+        const char* nameData = header + ZIP_CENTRAL_HEADER_SIZE;
+        ZipEntry entry;
+        entry.name = flags & ZIP_FLAG_UTF8 ? QString::fromUtf8(nameData, nameLength) : QString::fromLatin1(nameData, nameLength);
+        entry.name.replace('\\', '/');
+        entry.method = qFromLittleEndian<quint16>(header + 10);
+        entry.crc = qFromLittleEndian<quint32>(header + 16);
+        entry.compressedSize = qFromLittleEndian<quint32>(header + 20);
+        entry.localOffset = qFromLittleEndian<quint32>(header + 42);
+
+        entry.size = qFromLittleEndian<quint32>(header + 24);
+        readZip64Extra(nameData + nameLength, extraLength, &entry.size, &entry.compressedSize, &entry.localOffset);
+
+        if (flags & ZIP_FLAG_ENCRYPTED) {
+            *error = "Encrypted entries are not supported: " + entry.name;
+            return false;
+        }
+
+        entries->append(entry);
+        pos += recordSize;
+    }
+    return true;
+}
+
+// Runs on the extraction pool; each entry is read through its own handle on the archive
+bool ArchiveExtractor::extractEntry(const QString& archivePath, const ZipEntry& entry, qint64* written, QString* error, bool* corrupt) {
+    QFile archive(archivePath);
+    if (!archive.open(QIODevice::ReadOnly) || !archive.seek(entry.localOffset)) {
+        *error = "Failed to read " + entry.name + " from " + archivePath;
+        return false;
+    }
+
+    // The local header repeats the name but may carry a different extra field, only its lengths matter
+    const QByteArray header = archive.read(ZIP_LOCAL_HEADER_SIZE);
+    if (header.size() != ZIP_LOCAL_HEADER_SIZE || qFromLittleEndian<quint32>(header.constData()) != ZIP_LOCAL_HEADER
+        || !archive.seek(entry.localOffset + ZIP_LOCAL_HEADER_SIZE
+            + qFromLittleEndian<quint16>(header.constData() + 26) + qFromLittleEndian<quint16>(header.constData() + 28))) {
+        *error = "Corrupt local header for " + entry.name;
+        *corrupt = true;
+        return false;
+    }
+
+    QFile output(entry.targetPath);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = "Failed to create " + entry.targetPath + ": " + output.errorString();
+        return false;
+    }
+
+    Inflater inflater;
+    z_stream& stream = inflater.stream;
+    QByteArray input(EXTRACT_BUFFER_SIZE, Qt::Uninitialized);
+    quint32 crc = crc32(0L, Z_NULL, 0);
+    qint64 remaining = entry.compressedSize;
+    int status = Z_OK;
+
+    auto writeData = [&](const char* data, qint64 size) {
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(data), uInt(size));
+        if (output.write(data, size) != size) {
+            *error = "Failed to write " + entry.targetPath + ": " + output.errorString();
+            return false;
+        }
+        *written += size;
+        return true;
+    };
+
+    while (remaining > 0 && status != Z_STREAM_END) {
+        const qint64 bytesRead = archive.read(input.data(), qMin<qint64>(remaining, input.size()));
+        if (bytesRead <= 0) {
+            *error = "Truncated data for " + entry.name;
+            *corrupt = true;
+            return false;
+        }
+        remaining -= bytesRead;
+
+        if (entry.method == ZIP_STORED) {
+            if (!writeData(input.constData(), bytesRead)) return false;
+            continue;
+        }
+
+        if (!inflater.ok) {
+            *error = "Failed to initialise zlib";
+            return false;
+        }
+        stream.next_in = reinterpret_cast<Bytef*>(input.data());
+        stream.avail_in = uInt(bytesRead);
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(inflater.output.data());
+            stream.avail_out = uInt(inflater.output.size());
+
+            status = ::inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                *error = QString("Corrupt compressed data in %1 (zlib %2)").arg(entry.name).arg(status);
+                *corrupt = true;
+                return false;
+            }
+            if (!writeData(inflater.output.constData(), inflater.output.size() - stream.avail_out)) return false;
+        } while (status != Z_STREAM_END && (stream.avail_in > 0 || stream.avail_out == 0));
+    }
+
+    if (entry.method == ZIP_DEFLATED && entry.compressedSize > 0 && status != Z_STREAM_END) {
+        *error = "Truncated compressed data for " + entry.name;
+        *corrupt = true;
+        return false;
+    }
+    if (crc != entry.crc) {
+        *error = "CRC mismatch for " + entry.name;
+        *corrupt = true;
+        return false;
+    }
+    return true;
+}
+
+// Walks local file headers and entry data as far as the buffered bytes allow. Whatever is left
+// is an incomplete record and waits for the next chunk.
+void ArchiveExtractor::parse() {
+    qint64 pos = 0;
+
+    while (m_state != State::Done && m_state != State::Failed) {
+        const char* data = m_pending.constData() + pos;
+        const qint64 available = m_pending.size() - pos;
+
+        if (m_state == State::Header) {
+            if (available < 4) break;
+
+            const quint32 signature = qFromLittleEndian<quint32>(data);
+            if (signature == ZIP_CENTRAL_HEADER || signature == ZIP_END_OF_CENTRAL_DIRECTORY) {
+                m_state = State::Done;
+                break;
+            }
+            if (signature != ZIP_LOCAL_HEADER) {
+                fail("Not a zip archive or corrupt entry header", true);
+                break;
+            }
+            if (available < ZIP_LOCAL_HEADER_SIZE) break;
+
+            const int nameLength = qFromLittleEndian<quint16>(data + 26);
+            const int extraLength = qFromLittleEndian<quint16>(data + 28);
+            if (available < ZIP_LOCAL_HEADER_SIZE + nameLength + extraLength) break;
+
+            pos += ZIP_LOCAL_HEADER_SIZE + nameLength + extraLength;
+            openEntry(data, nameLength, extraLength);
+
+        } else if (m_state == State::Data) {
+            if (available == 0) break;
+            pos += m_entry.method == ZIP_STORED ? copyStored(data, available) : inflateData(data, available);
+
+        } else { // Descriptor: optional signature, CRC-32, then both sizes (64-bit for zip64 entries)
+            const qint64 length = m_entry.zip64 ? 20 : 12;
+            if (available < 4) break;
+
+            const qint64 signatureLength = qFromLittleEndian<quint32>(data) == ZIP_DATA_DESCRIPTOR ? 4 : 0;
+            if (available < signatureLength + length) break;
+
+            pos += signatureLength + length;
+            finishEntry(qFromLittleEndian<quint32>(data + signatureLength));
+        }
+    }
+
+    if (m_state == State::Done || m_state == State::Failed) {
+        m_pending.clear();
+    } else {
+        m_pending.remove(0, pos);
+    }
+}
+
+bool ArchiveExtractor::openEntry(const char* header, int nameLength, int extraLength) {
+    const quint16 flags = qFromLittleEndian<quint16>(header + 6);
+    const char* nameData = header + ZIP_LOCAL_HEADER_SIZE;
+
+    m_entry = Entry();
+    m_entry.method = qFromLittleEndian<quint16>(header + 8);
+    m_entry.expectedCrc = qFromLittleEndian<quint32>(header + 14);
+    m_entry.descriptor = flags & ZIP_FLAG_DESCRIPTOR;
+    m_entry.name = flags & ZIP_FLAG_UTF8 ? QString::fromUtf8(nameData, nameLength) : QString::fromLatin1(nameData, nameLength);
+    m_entry.name.replace('\\', '/');
+    m_entry.directory = m_entry.name.endsWith('/');
+
+    qint64 compressedSize = qFromLittleEndian<quint32>(header + 18);
+    qint64 size = qFromLittleEndian<quint32>(header + 22);
+
+    m_entry.zip64 = readZip64Extra(nameData + nameLength, extraLength, &size, &compressedSize, nullptr);
+
+    if (flags & ZIP_FLAG_ENCRYPTED) {
+        fail("Encrypted entries are not supported: " + m_entry.name);
+        return false;
+    }
+    if (m_entry.method != ZIP_STORED && m_entry.method != ZIP_DEFLATED) {
+        fail(QString("Unsupported compression method %1 for %2").arg(m_entry.method).arg(m_entry.name));
+        return false;
+    }
+    // A stored entry followed by a descriptor has no length anywhere before its data ends
+    if (m_entry.method == ZIP_STORED && m_entry.descriptor && compressedSize == 0 && !m_entry.directory) {
+        fail("Cannot stream stored entry of unknown size: " + m_entry.name);
+        return false;
+    }
+
+    // Everything lands under the staging directory, whatever the archive claims
+    QStringList parts;
+    if (!splitEntryPath(m_entry.name, &parts)) {
+        fail("Unsafe path in archive: " + m_entry.name);
+        return false;
+    }
+    m_topLevel.insert(parts.first());
+
+    const QString targetPath = m_stagingPath + "/" + parts.join('/');
+    if (m_entry.directory) {
+        QDir().mkpath(targetPath);
+    } else {
+        QDir().mkpath(QFileInfo(targetPath).absolutePath());
+        m_file.setFileName(targetPath);
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            fail("Failed to create " + targetPath + ": " + m_file.errorString());
+            return false;
+        }
+    }
+
+    m_entry.crc = crc32(0L, Z_NULL, 0);
+    m_entry.remaining = compressedSize;
+
+    if (!m_entry.descriptor && compressedSize == 0) {
+        finishEntry(m_entry.expectedCrc);
+    } else {
+        m_state = State::Data;
+    }
+    return true;
+}
+
+qint64 ArchiveExtractor::copyStored(const char* data, qint64 size) {
+    const qint64 length = qMin(size, m_entry.remaining);
+    if (!writeOutput(data, length)) return size;
+
+    m_entry.remaining -= length;
+    if (m_entry.remaining == 0) {
+        if (m_entry.descriptor) {
+            m_state = State::Descriptor;
+        } else {
+            finishEntry(m_entry.expectedCrc);
+        }
+    }
+    return length;
+}
+
+// Feeds as much input as zlib takes; the deflate stream marks its own end, so entries whose
+// sizes are only in a trailing descriptor still stream
+qint64 ArchiveExtractor::inflateData(const char* data, qint64 size) {
+    z_stream& stream = m_inflater->stream;
+    if (!m_inflater->ok) {
+        fail("Failed to initialise zlib");
+        return size;
+    }
+
+    const uInt input = uInt(qMin<qint64>(size, std::numeric_limits<int>::max()));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = input;
+
+    int status = Z_OK;
+    do {
+        stream.next_out = reinterpret_cast<Bytef*>(m_inflater->output.data());
+        stream.avail_out = uInt(m_inflater->output.size());
+
+        status = ::inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            fail(QString("Corrupt compressed data in %1 (zlib %2)").arg(m_entry.name).arg(status), true);
+            return size;
+        }
+
+        const qint64 produced = m_inflater->output.size() - stream.avail_out;
+        if (produced > 0 && !writeOutput(m_inflater->output.constData(), produced)) {
+            return size;
+        }
+    } while (status != Z_STREAM_END && (stream.avail_in > 0 || stream.avail_out == 0));
+
+    const qint64 consumed = input - stream.avail_in;
+    if (status == Z_STREAM_END) {
+        inflateReset(&stream);
+        if (m_entry.descriptor) {
+            m_state = State::Descriptor;
+        } else {
+            finishEntry(m_entry.expectedCrc);
+        }
+    }
+    return consumed;
+}
+
+bool ArchiveExtractor::writeOutput(const char* data, qint64 size) {
+    m_entry.crc = crc32(m_entry.crc, reinterpret_cast<const Bytef*>(data), uInt(size));
+    if (!m_file.isOpen()) return true; // Directory entries may still carry an empty deflate stream
+
+    if (m_file.write(data, size) != size) {
+        fail("Failed to write " + m_file.fileName() + ": " + m_file.errorString());
+        return false;
+    }
+    m_bytesWritten += size;
+    return true;
+}
+
+void ArchiveExtractor::finishEntry(quint32 crc) {
+    m_file.close();
+
+    if (crc != m_entry.crc) {
+        fail("CRC mismatch for " + m_entry.name, true);
+        return;
+    }
+    if (!m_entry.directory) {
+        m_files++;
+    }
+    m_state = State::Header;
+}
+
+void ArchiveExtractor::fail(const QString& error, bool corrupt) {
+    if (m_state == State::Failed) return;
+
+    qCWarning(loggerCategory) << "Extraction into" << m_stagingPath << "failed:" << error;
+    m_file.close();
+    m_error = error;
+    m_corrupt = corrupt;
+    m_state = State::Failed;
+}
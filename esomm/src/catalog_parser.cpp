@@ -0,0 +1,579 @@
+#include "catalog_parser.h"
+
+#include <QFile>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentMap>
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+CatalogParser::CatalogParser(const char* data, qint64 size)
+    : CatalogParser(data, size, 0) {
+}
+
+CatalogParser::CatalogParser(const char* data, qint64 size, qint64 start)
+    : m_begin(data), m_pos(data + start), m_end(data + size) {
+    if (start > 0) return;
+
+    // UTF-8 byte order mark
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        m_pos += 3;
+    }
+}
+
+bool CatalogParser::enterArray() {
+    skipWhitespace();
+    return expect('[') || fail("catalog is not a JSON array");
+}
+
+bool CatalogParser::next(ModInfo* mod) {
+    if (!beginEntry()) return false;
+
+    *mod = ModInfo();
+    return parseMod(mod);
+}
+
+bool CatalogParser::skipEntry() {
+    return beginEntry() && skipValue();
+}
+
+// Positions on the next entry's first byte, or consumes the closing ']'
+bool CatalogParser::beginEntry() {
+    if (m_done || hasError()) return false;
+
+    skipWhitespace();
+    if (peek(']')) {
+        m_pos++;
+        m_done = true;
+        skipWhitespace();
+        if (m_pos < m_end) fail("unexpected data after the catalog");
+        return false;
+    }
+    if (!m_first && !expect(',')) {
+        return fail("expected ',' between catalog entries");
+    }
+    m_first = false;
+    skipWhitespace();
+    return true;
+}
+
+void CatalogParser::skipWhitespace() {
+    while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\n' || *m_pos == '\r' || *m_pos == '\t')) {
+        m_pos++;
+    }
+}
+
+bool CatalogParser::peek(char c) {
+    return m_pos < m_end && *m_pos == c;
+}
+
+bool CatalogParser::expect(char c) {
+    skipWhitespace();
+    if (!peek(c)) return false;
+    m_pos++;
+    return true;
+}
+
+bool CatalogParser::fail(const char* what) {
+    if (m_error.isEmpty()) {
+        m_error = QString("%1 at offset %2").arg(QLatin1String(what)).arg(position());
+    }
+    return false;
+}
+
+// Object keys are plain ASCII in practice and are compared in place; scratch only holds escaped ones
+bool CatalogParser::readKey(QByteArray* key, QByteArray* scratch) {
+    const char* start = nullptr;
+    qint64 length = 0;
+    bool escaped = false;
+    if (!scanString(&start, &length, &escaped)) return false;
+
+    if (escaped) {
+        bool ok = false;
+        *scratch = unescape(start, length, &ok);
+        if (!ok) return fail("invalid escape in key");
+        *key = *scratch;
+    } else {
+        *key = QByteArray::fromRawData(start, length);
+    }
+    return expect(':') || fail("expected ':' after key");
+}
+
+// Leaves start/length on the raw contents between the quotes
+bool CatalogParser::scanString(const char** start, qint64* length, bool* escaped) {
+    skipWhitespace();
+    if (!peek('"')) return fail("expected string");
+
+    const char* p = ++m_pos;
+    *escaped = false;
+    while (p < m_end && *p != '"') {
+        if (*p == '\\') {
+            *escaped = true;
+            p++;
+        }
+        p++;
+    }
+    if (p >= m_end) return fail("unterminated string");
+
+    *start = m_pos;
+    *length = p - m_pos;
+    m_pos = p + 1;
+    return true;
+}
+
+bool CatalogParser::readString(QString* value, bool intern) {
+    skipWhitespace();
+    if (!peek('"')) {
+        return skipValue();
+    }
+
+    const char* start = nullptr;
+    qint64 length = 0;
+    bool escaped = false;
+    if (!scanString(&start, &length, &escaped)) return false;
+
+    if (!escaped) {
+        *value = intern && m_strings ? m_strings->intern(start, length) : QString::fromUtf8(start, length);
+        return true;
+    }
+
+    bool ok = false;
+    *value = QString::fromUtf8(unescape(start, length, &ok));
+    return ok || fail("invalid escape in string");
+}
+
+QByteArray CatalogParser::unescape(const char* start, qint64 length, bool* ok) {
+    QByteArray out;
+    out.reserve(length);
+    *ok = false;
+
+    const char* p = start;
+    const char* end = start + length;
+    const auto hex4 = [&](const char* at, char32_t* unit) {
+        if (end - at < 4) return false;
+        *unit = 0;
+        for (int i = 0; i < 4; i++) {
+            const char c = at[i];
+            const int digit = c >= '0' && c <= '9' ? c - '0'
+                : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (digit < 0) return false;
+            *unit = (*unit << 4) | char32_t(digit);
+        }
+        return true;
+    };
+
+    while (p < end) {
+        if (*p != '\\') {
+            out.append(*p++);
+            continue;
+        }
+        if (++p >= end) return out;
+
+        switch (*p++) {
+        case '"': out.append('"'); break;
+        case '\\': out.append('\\'); break;
+        case '/': out.append('/'); break;
+        case 'b': out.append('\b'); break;
+        case 'f': out.append('\f'); break;
+        case 'n': out.append('\n'); break;
+        case 'r': out.append('\r'); break;
+        case 't': out.append('\t'); break;
+        case 'u': {
+            char32_t code = 0;
+            if (!hex4(p, &code)) return out;
+            p += 4;
+
+            // Surrogate pair, an unpaired half becomes U+FFFD like QJsonDocument does
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                char32_t low = 0;
+                if (end - p >= 6 && p[0] == '\\' && p[1] == 'u' && hex4(p + 2, &low) && low >= 0xDC00 && low <= 0xDFFF) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                } else {
+                    code = 0xFFFD;
+                }
+            } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                code = 0xFFFD;
+            }
+            out.append(QString::fromUcs4(&code, 1).toUtf8());
+            break;
+        }
+        default:
+            return out;
+        }
+    }
+
+    *ok = true;
+    return out;
+}
+
+// -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?, as RFC 8259 has it
+bool CatalogParser::scanNumber() {
+    const char* p = m_pos;
+    const auto digits = [&p, this]() {
+        const char* start = p;
+        while (p < m_end && *p >= '0' && *p <= '9') p++;
+        return p > start;
+    };
+
+    if (p < m_end && *p == '-') p++;
+    if (p < m_end && *p == '0') {
+        p++;
+    } else if (!digits()) {
+        return fail("invalid number");
+    }
+    if (p < m_end && *p == '.') {
+        p++;
+        if (!digits()) return fail("invalid number");
+    }
+    if (p < m_end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < m_end && (*p == '+' || *p == '-')) p++;
+        if (!digits()) return fail("invalid number");
+    }
+
+    m_pos = p;
+    return true;
+}
+
+// Whatever follows a token is checked by the caller, which expects ',', '}' or ']' there
+bool CatalogParser::scanLiteral() {
+    for (const char* literal : { "true", "false", "null" }) {
+        const qint64 length = qint64(std::strlen(literal));
+        if (m_end - m_pos >= length && std::memcmp(m_pos, literal, length) == 0) {
+            m_pos += length;
+            return true;
+        }
+    }
+    return fail("unexpected character");
+}
+
+// QJsonValue::toInt(): integral numbers only, anything else reads as 0
+bool CatalogParser::readInt(int* value) {
+    skipWhitespace();
+    const char* start = m_pos;
+    if (!peek('-') && !(m_pos < m_end && *m_pos >= '0' && *m_pos <= '9')) {
+        return skipValue();
+    }
+    if (!scanNumber()) return false;
+
+    bool ok = false;
+    const double number = QByteArray::fromRawData(start, m_pos - start).toDouble(&ok);
+    if (!ok) return fail("invalid number");
+
+    const bool integral = number >= INT_MIN && number <= INT_MAX && number == std::trunc(number);
+    *value = integral ? int(number) : 0;
+    return true;
+}
+
+bool CatalogParser::readBool(bool* value) {
+    skipWhitespace();
+    if (m_end - m_pos >= 4 && std::memcmp(m_pos, "true", 4) == 0) {
+        m_pos += 4;
+        *value = true;
+        return true;
+    }
+    if (m_end - m_pos >= 5 && std::memcmp(m_pos, "false", 5) == 0) {
+        m_pos += 5;
+        *value = false;
+        return true;
+    }
+    return skipValue();
+}
+
+// Non-string elements are kept as empty strings, as QJsonValue::toString() would
+bool CatalogParser::readStringList(QList<QString>* values, bool intern) {
+    skipWhitespace();
+    if (!peek('[')) {
+        return skipValue();
+    }
+    m_pos++;
+
+    if (expect(']')) return true;
+    do {
+        QString value;
+        if (!readString(&value, intern)) return false;
+        values->append(value);
+    } while (expect(','));
+
+    return expect(']') || fail("expected ']' after array");
+}
+
+bool CatalogParser::skipValue(int depth) {
+    if (depth > CATALOG_MAX_DEPTH) return fail("nesting too deep");
+
+    skipWhitespace();
+    if (m_pos >= m_end) return fail("unexpected end of input");
+
+    const char c = *m_pos;
+    if (c == '"') {
+        const char* start = nullptr;
+        qint64 length = 0;
+        bool escaped = false;
+        return scanString(&start, &length, &escaped);
+    }
+    if (c == '{' || c == '[') {
+        const char close = c == '{' ? '}' : ']';
+        m_pos++;
+        if (expect(close)) return true;
+        do {
+            if (c == '{') {
+                QByteArray key;
+                QByteArray scratch;
+                if (!readKey(&key, &scratch)) return false;
+            }
+            if (!skipValue(depth + 1)) return false;
+        } while (expect(','));
+        return expect(close) || fail("unterminated object or array");
+    }
+
+    if (c == '-' || (c >= '0' && c <= '9')) {
+        return scanNumber();
+    }
+    return scanLiteral();
+}
+
+bool CatalogParser::parseMod(ModInfo* mod) {
+    if (!expect('{')) return fail("catalog entry is not an object");
+    mod->isInstalled = false;
+
+    if (!expect('}')) {
+        QByteArray scratch;
+        do {
+            QByteArray key;
+            if (!readKey(&key, &scratch)) return false;
+
+            bool ok = true;
+            if (key == "id") ok = readString(&mod->id);
+            else if (key == "categoryId") ok = readString(&mod->categoryId, true);
+            else if (key == "version") ok = readString(&mod->version, true);
+            else if (key == "lastUpdate") ok = readString(&mod->lastUpdate);
+            else if (key == "title") ok = readString(&mod->title);
+            else if (key == "author") ok = readString(&mod->author, true);
+            else if (key == "fileInfoUri") ok = readString(&mod->fileInfoUri);
+            else if (key == "checksum") ok = readString(&mod->checksum);
+            else if (key == "downloads") ok = readInt(&mod->downloads);
+            else if (key == "downloadsMonthly") ok = readInt(&mod->downloadsMonthly);
+            else if (key == "favorites") ok = readInt(&mod->favorites);
+            else if (key == "library") ok = readBool(&mod->library);
+            else if (key == "gameVersions") ok = readStringList(&mod->gameVersions, true);
+            else if (key == "donationUri" || key == "downloadUri") {
+                QString uri;
+                ok = readString(&uri);
+                (key == "donationUri" ? mod->donationUrl : mod->downloadUrl) = QUrl(uri);
+            } else if (key == "addons") {
+                skipWhitespace();
+                if (peek('[')) {
+                    m_pos++;
+                    if (!expect(']')) {
+                        do {
+                            skipWhitespace();
+                            if (peek('{')) {
+                                Dependancies addon;
+                                ok = parseAddon(&addon);
+                                mod->addons.append(addon);
+                            } else {
+                                ok = skipValue();
+                            }
+                        } while (ok && expect(','));
+                        ok = ok && (expect(']') || fail("expected ']' after addons"));
+                    }
+                } else {
+                    ok = skipValue();
+                }
+            } else {
+                ok = skipValue();
+            }
+            if (!ok) return false;
+        } while (expect(','));
+
+        if (!expect('}')) return fail("expected '}' after catalog entry");
+    }
+
+    if (!mod->lastUpdate.isEmpty()) {
+        mod->lastUpdated = QDateTime::fromString(mod->lastUpdate, Qt::ISODate);
+        if (!mod->lastUpdated.isValid()) {
+            mod->lastUpdated = QDateTime::fromString(mod->lastUpdate, "yyyy-MM-dd");
+        }
+    }
+    return true;
+}
+
+bool CatalogParser::parseAddon(Dependancies* addon) {
+    if (!expect('{')) return fail("expected addon object");
+    if (expect('}')) return true;
+
+    QByteArray scratch;
+    do {
+        QByteArray key;
+        if (!readKey(&key, &scratch)) return false;
+
+        bool ok = true;
+        if (key == "path") ok = readString(&addon->path);
+        else if (key == "addOnVersion") ok = readString(&addon->addOnVersion, true);
+        else if (key == "apiVersion") ok = readString(&addon->apiVersion, true);
+        else if (key == "library") ok = readBool(&addon->library);
+        else if (key == "optionalDependencies") ok = readStringList(&addon->optionalDependencies, true);
+        else if (key == "requiredDependencies") ok = readStringList(&addon->requiredDependencies, true);
+        else ok = skipValue();
+        if (!ok) return false;
+    } while (expect(','));
+
+    return expect('}') || fail("expected '}' after addon");
+}
+
+// Mapped pages are faulted in as the parser reaches them and can be dropped by the kernel
+// behind it, so the raw catalog never has to sit in the heap. Falls back to reading into
+// *fallback where the file cannot be mapped
+static bool mapCatalog(QFile& file, QByteArray* fallback, const char** data, qint64* size, QString* error) {
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    *size = file.size();
+    *data = *size > 0 ? reinterpret_cast<const char*>(file.map(0, *size)) : nullptr;
+    if (!*data) {
+        *fallback = file.readAll();
+        *data = fallback->constData();
+        *size = fallback->size();
+    }
+    return true;
+}
+
+bool CatalogParser::parseFile(const QString& filePath, const std::function<void(ModInfo&&)>& onMod, QString* error,
+    const CatalogParseOptions& options) {
+    QFile file(filePath);
+    QByteArray fallback;
+    const char* data = nullptr;
+    qint64 size = 0;
+    if (!mapCatalog(file, &fallback, &data, &size, error)) return false;
+
+    StringPool localStrings;
+    CatalogParser parser(data, size);
+    if (options.internStrings) {
+        parser.setStringPool(options.strings ? options.strings : &localStrings);
+    }
+    if (!parser.enterArray()) {
+        *error = parser.errorString();
+        return false;
+    }
+
+    ModInfo mod;
+    while (parser.next(&mod)) {
+        onMod(std::move(mod));
+    }
+
+    if (parser.hasError()) {
+        *error = parser.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool CatalogParser::parseFileParallel(const QString& filePath, QList<ModInfo>* mods, QString* error,
+    const CatalogParseOptions& options) {
+    QFile file(filePath);
+    QByteArray fallback;
+    const char* data = nullptr;
+    qint64 size = 0;
+    if (!mapCatalog(file, &fallback, &data, &size, error)) return false;
+
+    return parseParallel(data, size, mods, error, options);
+}
+
+// Two passes: a serial scan that only finds where each entry starts, stepping over the bytes
+// without decoding anything, then decoding of entry ranges on every core. Chunks are merged
+// back in catalog order
+bool CatalogParser::parseParallel(const char* data, qint64 size, QList<ModInfo>* mods, QString* error,
+    const CatalogParseOptions& options) {
+    struct Chunk {
+        qint64 start = 0; // Where the previous entry ended, before the separating ','
+        int count = 0;
+        bool first = false;
+        QList<ModInfo> mods;
+        QString error;
+    };
+
+    QThreadPool* pool = options.pool ? options.pool : QThreadPool::globalInstance();
+    const std::atomic<bool>* cancelled = options.cancelled;
+    StringPool localStrings; // Shared by all chunks so values repeat across the whole catalog
+    StringPool* strings = options.internStrings ? (options.strings ? options.strings : &localStrings) : nullptr;
+    const int threads = qMax(1, pool->maxThreadCount());
+
+    CatalogParser scanner(data, size);
+    if (!scanner.enterArray()) {
+        *error = scanner.errorString();
+        return false;
+    }
+
+    QList<qint64> starts;
+    for (;;) {
+        const qint64 start = scanner.position();
+        if (!scanner.skipEntry()) break;
+        starts.append(start);
+    }
+    if (scanner.hasError()) {
+        *error = scanner.errorString();
+        return false;
+    }
+
+    // A few chunks per thread evens out entries of very different sizes
+    const int perChunk = qMax(CATALOG_MIN_CHUNK_ENTRIES, int(starts.size() / (threads * 4)) + 1);
+    QList<Chunk> chunks;
+    for (int i = 0; i < starts.size(); i += perChunk) {
+        Chunk chunk;
+        chunk.start = starts[i];
+        chunk.count = qMin(perChunk, int(starts.size()) - i);
+        chunk.first = i == 0;
+        chunks.append(chunk);
+    }
+
+    const auto isCancelled = [cancelled]() { return cancelled && cancelled->load(std::memory_order_relaxed); };
+    if (isCancelled()) {
+        *error = "cancelled";
+        return false;
+    }
+
+    const auto decode = [data, size, strings, &isCancelled](Chunk& chunk) {
+        if (isCancelled()) {
+            chunk.error = "cancelled";
+            return;
+        }
+
+        CatalogParser parser(data, size, chunk.start);
+        parser.m_first = chunk.first;
+        parser.setStringPool(strings);
+
+        chunk.mods.reserve(chunk.count);
+        ModInfo mod;
+        for (int i = 0; i < chunk.count && parser.next(&mod); i++) {
+            chunk.mods.append(std::move(mod));
+        }
+        if (chunk.mods.size() != chunk.count) {
+            chunk.error = parser.hasError() ? parser.errorString() : QString("catalog entry count mismatch");
+        }
+    };
+
+    if (chunks.size() > 1 && threads > 1) {
+        QtConcurrent::blockingMap(pool, chunks, decode);
+    } else {
+        for (Chunk& chunk : chunks) decode(chunk);
+    }
+
+    for (const Chunk& chunk : chunks) {
+        if (!chunk.error.isEmpty()) {
+            *error = chunk.error;
+            return false;
+        }
+    }
+
+    mods->reserve(mods->size() + starts.size());
+    for (Chunk& chunk : chunks) {
+        mods->append(std::move(chunk.mods));
+    }
+    return true;
+}
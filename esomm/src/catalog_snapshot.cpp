@@ -0,0 +1,305 @@
+#include "catalog_snapshot.h"
+#include "logger.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QHash>
+
+#include <cstring>
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[4] = { 'E', 'S', 'O', 'C' };
+constexpr quint32 SNAPSHOT_BYTE_ORDER = 0x01020304; // Reads back differently on a host of the other endianness
+constexpr quint32 NO_STRING = 0xFFFFFFFF;
+// Smallest record: ten string indexes and the game version count, then the counters, date, flags and addon count
+constexpr qint64 MIN_RECORD_SIZE = 11 * sizeof(quint32) + 3 * sizeof(qint32) + 2 * sizeof(quint8)
+    + sizeof(qint64) + sizeof(qint32) + sizeof(quint32);
+
+struct SnapshotHeader {
+    char magic[4];
+    quint32 byteOrder;
+    quint32 version;
+    quint32 modCount;
+    quint32 stringCount;
+    quint32 reserved;
+    qint64 sourceSize;
+    qint64 sourceModified; // msecs since epoch
+    qint64 stringsOffset;
+    qint64 recordsOffset;
+    qint64 fileSize;       // Catches truncated files
+};
+
+// Appends plain values in host byte order; strings become indexes into a shared table
+class SnapshotWriter {
+public:
+    void u8(quint8 value) { m_records.append(char(value)); }
+    void u32(quint32 value) { m_records.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void i32(qint32 value) { m_records.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    void i64(qint64 value) { m_records.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+    void string(const QString& value) {
+        if (value.isNull()) {
+            u32(NO_STRING);
+            return;
+        }
+        auto it = m_indexes.constFind(value);
+        if (it == m_indexes.constEnd()) {
+            it = m_indexes.insert(value, quint32(m_indexes.size()));
+            const quint32 length = quint32(value.size());
+            m_strings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            m_strings.append(reinterpret_cast<const char*>(value.constData()), value.size() * sizeof(QChar));
+        }
+        u32(it.value());
+    }
+
+    void strings(const QList<QString>& values) {
+        u32(quint32(values.size()));
+        for (const QString& value : values) string(value);
+    }
+
+    const QByteArray& records() const { return m_records; }
+    const QByteArray& stringTable() const { return m_strings; }
+    quint32 stringCount() const { return quint32(m_indexes.size()); }
+
+private:
+    QByteArray m_records;
+    QByteArray m_strings;
+    QHash<QString, quint32> m_indexes;
+};
+
+// Bounds-checked reads from the mapped file. Any overrun clears ok and yields zeros
+class SnapshotReader {
+public:
+    SnapshotReader(const char* begin, const char* end, const QList<QString>* strings)
+        : m_pos(begin), m_end(end), m_strings(strings) {}
+
+    bool ok = true;
+
+    template <typename T>
+    T value() {
+        T result{};
+        if (m_end - m_pos < qint64(sizeof(T))) {
+            ok = false;
+            return result;
+        }
+        std::memcpy(&result, m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return result;
+    }
+
+    // Copies share the table's buffer, equal values across the catalog cost one allocation
+    QString string() {
+        const quint32 index = value<quint32>();
+        if (index == NO_STRING) return QString();
+        if (index >= quint32(m_strings->size())) {
+            ok = false;
+            return QString();
+        }
+        return m_strings->at(index);
+    }
+
+    QList<QString> strings() {
+        const quint32 count = value<quint32>();
+        QList<QString> result;
+        if (count > quint32(m_end - m_pos) / sizeof(quint32)) {
+            ok = false;
+            return result;
+        }
+        result.reserve(count);
+        for (quint32 i = 0; i < count && ok; i++) result.append(string());
+        return result;
+    }
+
+private:
+    const char* m_pos;
+    const char* m_end;
+    const QList<QString>* m_strings;
+};
+
+qint64 sourceModified(const QFileInfo& source) {
+    return source.lastModified().toMSecsSinceEpoch();
+}
+
+bool readHeader(const char* data, qint64 size, SnapshotHeader* header) {
+    if (size < qint64(sizeof(SnapshotHeader))) return false;
+    std::memcpy(header, data, sizeof(SnapshotHeader));
+
+    return std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+        && header->byteOrder == SNAPSHOT_BYTE_ORDER
+        && header->version == CATALOG_SNAPSHOT_VERSION
+        && header->fileSize == size
+        && header->stringsOffset >= qint64(sizeof(SnapshotHeader))
+        && header->stringsOffset <= header->recordsOffset
+        && header->recordsOffset <= size
+        // Counts are used to reserve memory, so they must fit in the bytes that hold them
+        && header->stringCount <= quint64(header->recordsOffset - header->stringsOffset) / sizeof(quint32)
+        && header->modCount <= quint64(size - header->recordsOffset) / MIN_RECORD_SIZE;
+}
+
+} // namespace
+
+bool CatalogSnapshot::save(const QString& path, const QList<ModInfo>& mods, qint64 sourceSize, const QDateTime& sourceModified) {
+    SnapshotWriter writer;
+    for (const ModInfo& mod : mods) {
+        writer.string(mod.id);
+        writer.string(mod.categoryId);
+        writer.string(mod.version);
+        writer.string(mod.lastUpdate);
+        writer.string(mod.title);
+        writer.string(mod.author);
+        writer.string(mod.fileInfoUri);
+        writer.strings(mod.gameVersions);
+        writer.string(mod.checksum);
+        writer.u8(mod.library);
+        writer.string(mod.donationUrl.isEmpty() ? QString() : mod.donationUrl.toString());
+        writer.string(mod.downloadUrl.toString());
+        writer.i32(mod.downloads);
+        writer.i32(mod.downloadsMonthly);
+        writer.i32(mod.favorites);
+
+        // Instant and UTC offset, so dates format the same as the parsed original
+        writer.u8(mod.lastUpdated.isValid());
+        writer.i64(mod.lastUpdated.isValid() ? mod.lastUpdated.toMSecsSinceEpoch() : 0);
+        writer.i32(mod.lastUpdated.isValid() ? mod.lastUpdated.offsetFromUtc() : 0);
+
+        writer.u32(quint32(mod.addons.size()));
+        for (const Dependancies& addon : mod.addons) {
+            writer.string(addon.path);
+            writer.string(addon.addOnVersion);
+            writer.string(addon.apiVersion);
+            writer.u8(addon.library);
+            writer.strings(addon.optionalDependencies);
+            writer.strings(addon.requiredDependencies);
+        }
+    }
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.version = CATALOG_SNAPSHOT_VERSION;
+    header.modCount = quint32(mods.size());
+    header.stringCount = writer.stringCount();
+    header.sourceSize = sourceSize;
+    header.sourceModified = sourceModified.toMSecsSinceEpoch();
+    header.stringsOffset = sizeof(SnapshotHeader);
+    header.recordsOffset = header.stringsOffset + writer.stringTable().size();
+    header.fileSize = header.recordsOffset + writer.records().size();
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(loggerCategory) << "Failed to write catalog snapshot:" << file.errorString();
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(writer.stringTable());
+    file.write(writer.records());
+    if (!file.commit()) {
+        qCWarning(loggerCategory) << "Failed to write catalog snapshot:" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool CatalogSnapshot::load(const QString& path, QList<ModInfo>* mods, QString* error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    const char* data = size > 0 ? reinterpret_cast<const char*>(file.map(0, size)) : nullptr;
+    SnapshotHeader header;
+    if (!data || !readHeader(data, size, &header)) {
+        *error = "not a current catalog snapshot";
+        return false;
+    }
+
+    // String table, one QString per distinct value
+    QList<QString> strings;
+    strings.reserve(header.stringCount);
+    const char* pos = data + header.stringsOffset;
+    const char* const stringsEnd = data + header.recordsOffset;
+    for (quint32 i = 0; i < header.stringCount; i++) {
+        quint32 length = 0;
+        if (stringsEnd - pos < qint64(sizeof(length))) break;
+        std::memcpy(&length, pos, sizeof(length));
+        pos += sizeof(length);
+        if (quint64(stringsEnd - pos) / sizeof(QChar) < length) break;
+
+        QString value(qsizetype(length), Qt::Uninitialized);
+        std::memcpy(value.data(), pos, length * sizeof(QChar));
+        pos += length * sizeof(QChar);
+        strings.append(value);
+    }
+    if (strings.size() != qsizetype(header.stringCount)) {
+        *error = "corrupt string table";
+        return false;
+    }
+
+    SnapshotReader reader(stringsEnd, data + size, &strings);
+    QList<ModInfo> result;
+    result.reserve(header.modCount);
+    for (quint32 i = 0; i < header.modCount && reader.ok; i++) {
+        ModInfo mod;
+        mod.id = reader.string();
+        mod.categoryId = reader.string();
+        mod.version = reader.string();
+        mod.lastUpdate = reader.string();
+        mod.title = reader.string();
+        mod.author = reader.string();
+        mod.fileInfoUri = reader.string();
+        mod.gameVersions = reader.strings();
+        mod.checksum = reader.string();
+        mod.library = reader.value<quint8>();
+        const QString donationUri = reader.string();
+        mod.donationUrl = donationUri.isNull() ? QUrl() : QUrl(donationUri);
+        mod.downloadUrl = QUrl(reader.string());
+        mod.downloads = reader.value<qint32>();
+        mod.downloadsMonthly = reader.value<qint32>();
+        mod.favorites = reader.value<qint32>();
+
+        const bool dated = reader.value<quint8>();
+        const qint64 msecs = reader.value<qint64>();
+        const qint32 offset = reader.value<qint32>();
+        if (dated) {
+            mod.lastUpdated = QDateTime::fromMSecsSinceEpoch(msecs).toOffsetFromUtc(offset);
+        }
+
+        const quint32 addonCount = reader.value<quint32>();
+        for (quint32 a = 0; a < addonCount && reader.ok; a++) {
+            Dependancies addon;
+            addon.path = reader.string();
+            addon.addOnVersion = reader.string();
+            addon.apiVersion = reader.string();
+            addon.library = reader.value<quint8>();
+            addon.optionalDependencies = reader.strings();
+            addon.requiredDependencies = reader.strings();
+            mod.addons.append(addon);
+        }
+
+        result.append(std::move(mod));
+    }
+
+    if (!reader.ok) {
+        *error = "corrupt catalog records";
+        return false;
+    }
+
+    *mods = std::move(result);
+    return true;
+}
+
+bool CatalogSnapshot::isBuiltFrom(const QString& path, const QFileInfo& source) {
+    QFile file(path);
+    if (!source.exists() || !file.open(QIODevice::ReadOnly)) return false;
+
+    const QByteArray head = file.read(sizeof(SnapshotHeader));
+    SnapshotHeader header;
+    return head.size() == qsizetype(sizeof(SnapshotHeader))
+        && readHeader(head.constData(), file.size(), &header)
+        && header.sourceSize == source.size()
+        && header.sourceModified == sourceModified(source);
+}
@@ -0,0 +1,309 @@
+#include "catalog_store.h"
+
+#include <QSet>
+
+#include <algorithm>
+
+static quint8 flagsOf(const ModInfo& mod) {
+    quint8 flags = 0;
+    if (mod.isInstalled) flags |= CatalogStore::Installed;
+    if (mod.hasUpdate) flags |= CatalogStore::HasUpdate;
+    if (mod.library) flags |= CatalogStore::Library;
+    return flags;
+}
+
+static qint64 timestampOf(const ModInfo& mod) {
+    return mod.lastUpdated.isValid() ? mod.lastUpdated.toMSecsSinceEpoch() : CATALOG_NO_TIMESTAMP;
+}
+
+// Drops the given rows, ascending, shifting the rest down in one pass
+template <typename T>
+static void removeSorted(QList<T>* column, const QList<int>& rows) {
+    int next = 0;
+    int kept = 0;
+    for (int row = 0; row < column->size(); row++) {
+        if (next < rows.size() && rows[next] == row) {
+            next++;
+            continue;
+        }
+        if (kept != row) (*column)[kept] = std::move((*column)[row]);
+        kept++;
+    }
+    column->resize(kept);
+}
+
+void CatalogStore::clear() {
+    m_ids.clear();
+    m_titles.clear();
+    m_flags.clear();
+    m_downloads.clear();
+    m_downloadsMonthly.clear();
+    m_favorites.clear();
+    m_lastUpdated.clear();
+    m_records.clear();
+    m_idIndex.clear();
+    m_titleIndex.clear();
+    m_folderIndex.clear();
+}
+
+void CatalogStore::assign(QList<ModInfo>&& mods) {
+    clear();
+
+    const qsizetype count = mods.size();
+    m_ids.reserve(count);
+    m_titles.reserve(count);
+    m_flags.reserve(count);
+    m_downloads.reserve(count);
+    m_downloadsMonthly.reserve(count);
+    m_favorites.reserve(count);
+    m_lastUpdated.reserve(count);
+    m_records.reserve(count);
+    m_idIndex.reserve(count);
+    m_titleIndex.reserve(count);
+
+    for (ModInfo& mod : mods) {
+        append(std::move(mod));
+    }
+    mods.clear();
+}
+
+int CatalogStore::append(ModInfo mod) {
+    m_ids.append(mod.id);
+    m_titles.append(mod.title);
+    m_flags.append(flagsOf(mod));
+    m_downloads.append(mod.downloads);
+    m_downloadsMonthly.append(mod.downloadsMonthly);
+    m_favorites.append(mod.favorites);
+    m_lastUpdated.append(timestampOf(mod));
+    m_records.append(std::move(mod));
+
+    const int row = size() - 1;
+    indexRow(row);
+    return row;
+}
+
+// Entries without an id, and repeats of an id already seen, are not taken over. Rows the
+// incoming catalog no longer lists are removed, whatever their install state
+CatalogDiff CatalogStore::diff(const QList<ModInfo>& incoming) const {
+    CatalogDiff result;
+
+    QList<bool> listed(size(), false);
+    QSet<QString> seen;
+    seen.reserve(incoming.size());
+    for (int pos = 0; pos < incoming.size(); pos++) {
+        const ModInfo& mod = incoming[pos];
+        if (mod.id.isEmpty() || seen.contains(mod.id)) continue;
+        seen.insert(mod.id);
+
+        const int row = findId(mod.id);
+        if (row < 0) {
+            result.added.append(pos);
+            continue;
+        }
+
+        const ModInfo& current = m_records[row];
+        listed[row] = true;
+        if (current.version != mod.version || current.checksum != mod.checksum || current.lastUpdate != mod.lastUpdate) {
+            result.changed.append({ row, pos });
+        } else if (current.downloads != mod.downloads || current.downloadsMonthly != mod.downloadsMonthly
+                   || current.favorites != mod.favorites) {
+            result.recounted.append({ row, pos });
+        }
+    }
+
+    for (int row = 0; row < size(); row++) {
+        if (!listed[row]) result.removed.append(row);
+    }
+    return result;
+}
+
+void CatalogStore::apply(const CatalogDiff& diff, QList<ModInfo>&& incoming) {
+    for (const QPair<int, int>& change : diff.changed) {
+        setRecord(change.first, std::move(incoming[change.second]));
+    }
+    for (const QPair<int, int>& recount : diff.recounted) {
+        const ModInfo& mod = incoming[recount.second];
+        ModInfo& record = m_records[recount.first];
+        record.downloads = m_downloads[recount.first] = mod.downloads;
+        record.downloadsMonthly = m_downloadsMonthly[recount.first] = mod.downloadsMonthly;
+        record.favorites = m_favorites[recount.first] = mod.favorites;
+    }
+
+    // Rows of the diff refer to the store before any removal
+    removeRows(diff.removed);
+    for (int pos : diff.added) {
+        append(std::move(incoming[pos]));
+    }
+    incoming.clear();
+}
+
+// Catalog fields are replaced, the install state of the row stays
+void CatalogStore::setRecord(int row, ModInfo mod) {
+    const ModInfo& current = m_records[row];
+    mod.isInstalled = current.isInstalled;
+    mod.installPath = current.installPath;
+    mod.hasUpdate = current.hasUpdate;
+
+    unindexRow(row);
+    m_ids[row] = mod.id;
+    m_titles[row] = mod.title;
+    m_flags[row] = flagsOf(mod);
+    m_downloads[row] = mod.downloads;
+    m_downloadsMonthly[row] = mod.downloadsMonthly;
+    m_favorites[row] = mod.favorites;
+    m_lastUpdated[row] = timestampOf(mod);
+    m_records[row] = std::move(mod);
+    indexRow(row);
+}
+
+void CatalogStore::removeRows(QList<int> rows) {
+    if (rows.isEmpty()) return;
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+    removeSorted(&m_ids, rows);
+    removeSorted(&m_titles, rows);
+    removeSorted(&m_flags, rows);
+    removeSorted(&m_downloads, rows);
+    removeSorted(&m_downloadsMonthly, rows);
+    removeSorted(&m_favorites, rows);
+    removeSorted(&m_lastUpdated, rows);
+    removeSorted(&m_records, rows);
+
+    // Every row after the first removed one moved
+    reindex();
+}
+
+void CatalogStore::indexRow(int row) {
+    const ModInfo& record = m_records[row];
+    m_idIndex.insert(record.id, row);
+    m_titleIndex.insert(record.title, row);
+    for (const Dependancies& addon : record.addons) {
+        if (!addon.path.isEmpty()) m_folderIndex.insert(addon.path, row);
+    }
+}
+
+void CatalogStore::unindexRow(int row) {
+    const ModInfo& record = m_records[row];
+    m_idIndex.remove(record.id, row);
+    m_titleIndex.remove(record.title, row);
+    for (const Dependancies& addon : record.addons) {
+        m_folderIndex.remove(addon.path, row);
+    }
+}
+
+void CatalogStore::reindex() {
+    m_idIndex.clear();
+    m_titleIndex.clear();
+    m_folderIndex.clear();
+    m_idIndex.reserve(size());
+    m_titleIndex.reserve(size());
+    for (int row = 0; row < size(); row++) {
+        indexRow(row);
+    }
+}
+
+QList<ModInfo> CatalogStore::records(const QList<int>& rows) const {
+    QList<ModInfo> result;
+    result.reserve(rows.size());
+    for (int row : rows) {
+        result.append(m_records[row]);
+    }
+    return result;
+}
+
+void CatalogStore::setFlag(int row, Flag flag, bool on) {
+    m_flags[row] = quint8(on ? (m_flags[row] | flag) : (m_flags[row] & ~flag));
+}
+
+void CatalogStore::setInstalled(int row, const QString& installPath) {
+    ModInfo& record = m_records[row];
+    record.isInstalled = !installPath.isEmpty();
+    record.installPath = installPath;
+    if (!record.isInstalled) {
+        record.hasUpdate = false;
+        setFlag(row, HasUpdate, false);
+    }
+    setFlag(row, Installed, record.isInstalled);
+}
+
+void CatalogStore::setHasUpdate(int row, bool hasUpdate) {
+    m_records[row].hasUpdate = hasUpdate;
+    setFlag(row, HasUpdate, hasUpdate);
+}
+
+void CatalogStore::clearFlags(quint8 flags) {
+    for (int row = 0; row < size(); row++) {
+        if (!(m_flags[row] & flags)) continue;
+
+        m_flags[row] = quint8(m_flags[row] & ~flags);
+        ModInfo& record = m_records[row];
+        if (flags & Installed) {
+            record.isInstalled = false;
+            record.installPath.clear();
+        }
+        if (flags & HasUpdate) record.hasUpdate = false;
+        if (flags & Library) record.library = false;
+    }
+}
+
+QList<int> CatalogStore::rowsWith(quint8 set, quint8 unset) const {
+    QList<int> rows;
+    const quint8* flags = m_flags.constData();
+    for (int row = 0; row < size(); row++) {
+        if ((flags[row] & set) == set && !(flags[row] & unset)) {
+            rows.append(row);
+        }
+    }
+    return rows;
+}
+
+// A key rarely maps to more than one row, so walking its rows is as good as constant time
+int CatalogStore::findIndexed(const QMultiHash<QString, int>& index, const QString& key, quint8 set, quint8 unset) const {
+    int found = -1;
+    const auto range = index.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        const int row = it.value();
+        if ((m_flags[row] & set) == set && !(m_flags[row] & unset) && (found < 0 || row < found)) {
+            found = row;
+        }
+    }
+    return found;
+}
+
+int CatalogStore::findId(const QString& id, quint8 set, quint8 unset) const {
+    return findIndexed(m_idIndex, id, set, unset);
+}
+
+int CatalogStore::findTitle(const QString& title, quint8 set, quint8 unset) const {
+    return findIndexed(m_titleIndex, title, set, unset);
+}
+
+QList<int> CatalogStore::rowsWithFolder(const QString& folder) const {
+    QList<int> rows = m_folderIndex.values(folder);
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    return rows;
+}
+
+// Comparisons read one column only; ties keep catalog order
+void CatalogStore::sortRows(QList<int>* rows, CatalogSortKey key, Qt::SortOrder order) const {
+    const auto sortBy = [rows, order](const auto& column) {
+        std::stable_sort(rows->begin(), rows->end(), [&column, order](int a, int b) {
+            return order == Qt::AscendingOrder ? column[a] < column[b] : column[b] < column[a];
+        });
+    };
+
+    switch (key) {
+    case CatalogSortKey::Title:
+        std::stable_sort(rows->begin(), rows->end(), [this, order](int a, int b) {
+            const int compared = m_titles[a].compare(m_titles[b], Qt::CaseInsensitive);
+            return order == Qt::AscendingOrder ? compared < 0 : compared > 0;
+        });
+        break;
+    case CatalogSortKey::Downloads: sortBy(m_downloads); break;
+    case CatalogSortKey::DownloadsMonthly: sortBy(m_downloadsMonthly); break;
+    case CatalogSortKey::Favorites: sortBy(m_favorites); break;
+    case CatalogSortKey::LastUpdated: sortBy(m_lastUpdated); break;
+    }
+}
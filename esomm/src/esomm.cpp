@@ -9,8 +9,6 @@ ESOMM::ESOMM(QWidget *parent) : QWidget(parent), manager(new Manager(this)), ui(
     setConnections();
     initUI();
 
-    connect(manager, &Manager::availableModsLoaded, manager, &Manager::scanInstalledMods);
-
     manager->loadAvailableMods();
 }
 
@@ -67,6 +65,9 @@ void ESOMM::setConnections() {
     connect(manager, &Manager::modActionCompleted,
         this, &ESOMM::onModActionCompleted);
 
+    connect(manager, &Manager::modsUpdated,
+        this, &ESOMM::onModsUpdated);
+
     // UI
     connect(ui->btnManage, &QPushButton::clicked,
         this, &ESOMM::onManageClicked);
@@ -100,6 +101,10 @@ void ESOMM::setConnections() {
         connect(ui->uninstallModButton, &QPushButton::clicked,
             this, &ESOMM::onUninstallModClicked);
     }
+    if (ui->updateAllButton) {
+        connect(ui->updateAllButton, &QPushButton::clicked,
+            this, &ESOMM::onUpdateAllClicked);
+    }
 }
 
 void ESOMM::onManageClicked() {
@@ -146,17 +151,29 @@ void ESOMM::onModActionCompleted(const QString& action, const QString& modTitle,
     // Hide progress indicator
     // progressBar->setVisible(false);
 
+    // A batch update rescans once at the end, see onModsUpdated
+    if (manager->isUpdatingBatch()) return;
+
     if (action == "install" || action == "uninstall" || action == "update") {
-        manager->scanInstalledMods(); // This will trigger onInstalledModsChanged
+        manager->scanInstalledMods(); // Rescans in the background, then triggers onInstalledModsChanged
         qCInfo(loggerCategory) << "onModActionCompleted triggered scanInstalledMods";
     }
 }
 
+void ESOMM::onModsUpdated(const QStringList& updatedTitles, const QStringList& failedTitles) {
+    if (failedTitles.isEmpty()) {
+        updateStatusText(QString("Updated %1 mods").arg(updatedTitles.size()));
+    } else {
+        updateStatusText(QString("Updated %1 mods, %2 failed: %3")
+            .arg(updatedTitles.size()).arg(failedTitles.size()).arg(failedTitles.join(", ")));
+    }
+}
+
 void ESOMM::onInstalledModClicked(QListWidgetItem* item) {
     if (!item) return;
 
     const QString modId = item->data(Qt::UserRole).toString();
-    ModInfo* mod = manager->getInstalledMod(modId);
+    const ModInfo* mod = manager->getInstalledMod(modId);
 
     qCInfo(loggerCategory) << "Installed mod clicked: " << modId;
 
@@ -176,6 +193,12 @@ void ESOMM::onUpdateModClicked() {
     manager->updateMod(selectedModId);
 }
 
+void ESOMM::onUpdateAllClicked() {
+    if (manager->updateAllMods() > 0 && ui->updateAllButton) {
+        ui->updateAllButton->setEnabled(false);
+    }
+}
+
 void ESOMM::onUninstallModClicked() {
     if (selectedModId.isEmpty()) return;
 
@@ -216,6 +239,10 @@ void ESOMM::updateInstalledModsList() {
     clearModDetails();
     selectedModId.clear();
 
+    if (ui->updateAllButton) {
+        ui->updateAllButton->setEnabled(!manager->isUpdatingBatch() && !manager->getModsWithUpdates().isEmpty());
+    }
+
     updateStatusText(QString("Found %1 installed mods").arg(installedMods.size()));
 }
 
@@ -2,26 +2,61 @@
 #include "logger.h"
 #include "pathing.h"
 
-#include <QMutexLocker>
 #include <QTimer>
 #include <QSslError>
-#include <QEventLoop>
 #include <QFileInfo>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QDateTime>
+#include <QMetaMethod>
+
+#include <cctype>
+#include <filesystem>
+#include <system_error>
+
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#else
+#include <QtZlib/zlib.h>
+#endif
+
+// Decodes gzip and zlib-wrapped deflate bodies; windowBits 32 detects which header the body has
+struct HttpClient::Decoder {
+    Decoder() {
+        output.resize(STREAM_BUFFER_SIZE);
+        ok = inflateInit2(&stream, 32 + MAX_WBITS) == Z_OK;
+    }
+    ~Decoder() {
+        if (ok) inflateEnd(&stream);
+    }
 
-// NEED TO REFACTOR FOR CLARITY
+    z_stream stream = {};
+    QByteArray output;
+    bool ok = false;
+    bool finished = false;
+};
 
-// HttpClient will run on a separate thread
+// HttpClient is moved to a dedicated network thread by its owner. Everything below
+// runs on that thread; the public entry points hop onto it with a queued call.
 HttpClient::HttpClient(int maxConcurrentDownloads, QObject* parent)
-    : QObject(parent), m_maxConcurrentDownloads(maxConcurrentDownloads) {
-
-    m_threadPool = new QThreadPool(this);
-    m_threadPool->setMaxThreadCount(maxConcurrentDownloads);
+    : QObject(parent), m_maxConcurrentDownloads(qMax(1, maxConcurrentDownloads)) {
 
     m_networkManager = new QNetworkAccessManager(this);
     m_networkManager->setTransferTimeout(REQUEST_TIMEOUT_MS);
 
+    m_clock.start();
     initHeaders();
 
+    m_wakeUpTimer = new QTimer(this);
+    m_wakeUpTimer->setSingleShot(true);
+    connect(m_wakeUpTimer, &QTimer::timeout, this, &HttpClient::checkDownloadQueue);
+
+    m_progressTimer = new QTimer(this);
+    m_progressTimer->setInterval(PROGRESS_INTERVAL_MS);
+    connect(m_progressTimer, &QTimer::timeout, this, &HttpClient::reportBatchProgress);
+
     // Signal to handle SSL errors
     connect(m_networkManager, &QNetworkAccessManager::sslErrors,
         this, [this](QNetworkReply* reply, const QList<QSslError>& errors) {
@@ -34,30 +69,45 @@ HttpClient::HttpClient(int maxConcurrentDownloads, QObject* parent)
 }
 
 HttpClient::~HttpClient() {
-    {
-        QMutexLocker locker(&m_qMutex);
-        m_downloadQueue.clear();
+    for (auto& queue : m_downloadQueues) {
+        queue.clear();
     }
 
-    for (QNetworkReply* reply : m_activeDownloads.keys()) {
-        if (reply && reply->isRunning()) {
+    // Detach first so aborting does not schedule retries; partial files are kept for the next launch
+    for (auto it = m_activeDownloads.begin(); it != m_activeDownloads.end(); ++it) {
+        QNetworkReply* reply = it.key();
+        reply->disconnect(this);
+        if (reply->isRunning()) {
             reply->abort();
         }
+        suspendPartial(it.value().get());
     }
+    m_activeDownloads.clear();
+    m_activeByKey.clear();
+    m_activePaths.clear();
+}
 
-    for (auto watcher : m_futureWatchers) {
-        if (watcher->isRunning()) {
-            watcher->cancel();
-        }
-        delete watcher;
+// Moves the finished part file over the target in one step, replacing any previous version
+static bool replaceFile(const QString& from, const QString& to) {
+    std::error_code error;
+    std::filesystem::rename(std::filesystem::path(from.toStdU16String()),
+        std::filesystem::path(to.toStdU16String()), error);
+
+    if (error) {
+        qCWarning(loggerCategory) << "Failed to move" << from << "to" << to << "-" << QString::fromStdString(error.message());
+        return false;
     }
-    m_futureWatchers.clear();
+    return true;
+}
 
-    m_threadPool->waitForDone();
+// "bytes 100-999/1000" -> 100
+static qint64 contentRangeStart(QNetworkReply* reply) {
+    const QByteArray range = reply->rawHeader("Content-Range").trimmed();
+    if (!range.startsWith("bytes ")) return -1;
 
-    if (m_networkManager) {
-        m_networkManager->deleteLater();
-    }
+    bool ok = false;
+    const qint64 start = range.mid(6, range.indexOf('-') - 6).toLongLong(&ok);
+    return ok ? start : -1;
 }
 
 void HttpClient::initHeaders() {
@@ -65,7 +115,6 @@ void HttpClient::initHeaders() {
         {"User-Agent", "Mozilla/5.0 (Windows NT 10.0; Win64; x64; rv:137.0) Gecko/20100101 Firefox/137.0"},
         {"Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8"},
         {"Accept-Language", "en-US,en;q=0.5"},
-        {"Accept-Encoding", "gzip, deflate, br, zstd"},
         {"Connection", "keep-alive"},
         {"Upgrade-Insecure-Requests", "1"},
         {"Sec-Fetch-Dest", "document"},
@@ -79,286 +128,917 @@ QNetworkRequest HttpClient::createRequest(const QUrl& url) const {
     QNetworkRequest request(url);
 
     for (const auto& header : m_headers.keys()) {
-        if (header != "Accept-Encoding") {
-            request.setRawHeader(header.toUtf8(), m_headers.value(header).toUtf8());
-        }
+        request.setRawHeader(header.toUtf8(), m_headers.value(header).toUtf8());
     }
 
-    request.setRawHeader("Accept-Encoding", "identity"); // Request uncompressed content
+    // Set by hand, which stops QNetworkAccessManager from decoding the body itself. Qt would also
+    // drop Content-Length and hide the compressed size; writeChunk() counts it and inflates instead
+    request.setRawHeader("Accept-Encoding", "gzip, deflate");
     return request;
 }
 
-void HttpClient::addDownload(const QUrl& url, const QString& filePath) {
+void HttpClient::addDownload(const QUrl& url, const QString& filePath, const DownloadOptions& options) {
     if (!url.isValid()) {
         qCWarning(loggerCategory) << "Invalid URL provided:" << url.toString();
         emit downloadFailed(filePath, "Invalid URL provided");
         return;
     }
 
-    {
-        QMutexLocker locker(&m_qMutex);
-        m_downloadQueue.enqueue({ url, filePath });
-    }
-    QTimer::singleShot(0, this, &HttpClient::processDownloadQueue);
+    const Download download{ url, filePath, options };
+    QMetaObject::invokeMethod(this, [this, download]() {
+        enqueue(download);
+        processDownloadQueue();
+    }, Qt::QueuedConnection);
 }
 
 void HttpClient::checkDownloadQueue() {
-    QMutexLocker locker(&m_qMutex);
-    int availableSlots = m_maxConcurrentDownloads - m_activeDownloads.size();
+    processDownloadQueue();
+
+    if (isQueueEmpty() && m_activeDownloads.isEmpty()) {
+        if (m_progressTimer->isActive()) {
+            reportBatchProgress();
+            m_progressTimer->stop();
+        }
+        m_batchFinishedBytes = 0;
+        m_batchLastBytes = 0;
+        m_batchRate = 0;
 
-    if (availableSlots > 0 && !m_downloadQueue.isEmpty()) {
-        locker.unlock();
-        processDownloadQueue();
-    }
-    else if (m_downloadQueue.isEmpty() && m_activeDownloads.isEmpty()) {
-        locker.unlock();
         emit allDownloadsFinished();
     }
 }
 
-void HttpClient::processDownloadQueue() {
-    QVector<Download> downloadsToProcess;
+// A download that failed before its request went out still counts towards the batch: the queue is
+// checked again so the next item starts, or allDownloadsFinished fires if it was the last one.
+// Queued, since start() runs from inside processDownloadQueue()
+void HttpClient::finishUnstarted() {
+    QMetaObject::invokeMethod(this, &HttpClient::checkDownloadQueue, Qt::QueuedConnection);
+}
 
-    {
-        QMutexLocker locker(&m_qMutex);
-        int availableSlots = m_maxConcurrentDownloads - m_activeDownloads.size();
+QString HttpClient::downloadKey(const Download& download) const {
+    return download.url.toString() + '\n' + resolveFilePath(download);
+}
 
-        while (!m_downloadQueue.isEmpty() && availableSlots > 0) {
-            downloadsToProcess.append(m_downloadQueue.dequeue());
-            availableSlots--;
+// Duplicate requests never cause a second transfer: one already in flight simply gains another
+// caller (signals are keyed by file path, so every caller sees its progress and completion),
+// and asking again for something queued only ever raises its priority
+void HttpClient::enqueue(Download download) {
+    const QString key = downloadKey(download);
+
+    if (const auto transfer = m_activeByKey.value(key)) {
+        transfer->requests++;
+        qCInfo(loggerCategory) << "Attached to in-flight download" << download.url.toString()
+            << "now serving" << transfer->requests << "requests";
+
+        // A retry is queued from the transfer's options, so it keeps the most urgent caller's priority
+        DownloadOptions& options = transfer->download.options;
+        if (download.options.priority < options.priority) {
+            options.priority = download.options.priority;
+        }
+        if (!download.options.expectedChecksum.isEmpty()
+            && download.options.expectedChecksum.toLower() != options.expectedChecksum.toLower()) {
+            qCWarning(loggerCategory) << "Attached to" << download.url.toString() << "expecting checksum"
+                << download.options.expectedChecksum << "but the transfer verifies" << options.expectedChecksum;
         }
+        return;
     }
 
-    for (const auto& download : downloadsToProcess) {
-        QFutureWatcher<void>* watcher = new QFutureWatcher<void>(this);
-        m_futureWatchers.append(watcher);
+    for (auto& queue : m_downloadQueues) {
+        for (qsizetype i = 0; i < queue.size(); i++) {
+            if (downloadKey(queue[i]) != key) continue;
 
-        QString filePath = download.filePath;
-        connect(watcher, &QFutureWatcher<void>::progressValueChanged, this, [this, filePath](int progress) {
-            emit downloadProgress(filePath, progress, 100);
-            });
+            if (download.options.priority < queue[i].options.priority) {
+                Download queued = queue.takeAt(i);
+                queued.options.priority = download.options.priority;
+                insertByWaitTime(queued);
+                qCInfo(loggerCategory) << "Raised priority of queued download" << download.url.toString();
+            }
+            return;
+        }
+    }
 
-        connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher]() {
-            m_futureWatchers.removeOne(watcher);
-            watcher->deleteLater();
-            QTimer::singleShot(0, this, &HttpClient::checkDownloadQueue);
-        });
+    download.enqueuedAt = m_clock.elapsed();
+    m_downloadQueues[static_cast<int>(download.options.priority)].enqueue(download);
+}
 
-        // Begin concurrent job
-        QFuture<void> future = QtConcurrent::run(m_threadPool, [this, download]() {
-            start(download);
-            });
+// A raised item keeps the time it was first queued, so it goes where that time puts it in its new
+// class; appending it would break the FIFO order takeNextDownload relies on
+void HttpClient::insertByWaitTime(const Download& download) {
+    QQueue<Download>& queue = m_downloadQueues[static_cast<int>(download.options.priority)];
+    qsizetype i = queue.size();
+    while (i > 0 && queue[i - 1].enqueuedAt > download.enqueuedAt) i--;
+    queue.insert(i, download);
+}
 
-        watcher->setFuture(future);
+// Picks the most urgent dispatchable item across the priority classes. Waiting time is subtracted
+// from the class (in milliseconds, PRIORITY_AGING_MS per class) so nothing starves, and items whose
+// host is at its limit are passed over. Background and Prefetch stop half a class ahead of a fresh
+// install: a steady stream of installs cannot hold updates back for good, while one that has
+// waited half an interval still goes first. They never take the reserved slots, see canDispatch()
+bool HttpClient::takeNextDownload(Download* next) {
+    const qint64 now = m_clock.elapsed();
+    const int background = static_cast<int>(DownloadPriority::Background);
+    const qint64 agedFloor = static_cast<int>(DownloadPriority::Interactive) * qint64(PRIORITY_AGING_MS) - PRIORITY_AGING_MS / 2;
+
+    int bestQueue = -1;
+    qsizetype bestIndex = -1;
+    qint64 bestPriority = 0;
+
+    for (int i = 0; i < static_cast<int>(m_downloadQueues.size()); i++) {
+        const QQueue<Download>& queue = m_downloadQueues[i];
+
+        // FIFO within a class, so the first dispatchable item is also the one that waited longest
+        for (qsizetype j = 0; j < queue.size(); j++) {
+            qint64 effectivePriority = i * qint64(PRIORITY_AGING_MS) - (now - queue[j].enqueuedAt);
+            if (i >= background) effectivePriority = qMax(agedFloor, effectivePriority);
+            if (!canDispatch(queue[j], now)) continue;
+
+            if (bestQueue < 0 || effectivePriority < bestPriority) {
+                bestQueue = i;
+                bestIndex = j;
+                bestPriority = effectivePriority;
+            }
+            break;
+        }
     }
+
+    if (bestQueue < 0) return false;
+
+    *next = m_downloadQueues[bestQueue].takeAt(bestIndex);
+    return true;
 }
 
-void HttpClient::start(const Download& download) {
-    QNetworkRequest request = createRequest(download.url);
+// Waits out backoffs and host cooldowns. Background work leaves the reserved slots free,
+// both overall and on its host; aging never lifts an item out of that rule.
+bool HttpClient::canDispatch(const Download& download, qint64 now) const {
+    if (download.notBefore > now || m_activePaths.contains(resolveFilePath(download))) {
+        return false;
+    }
+
+    const int reserved = download.options.priority > DownloadPriority::Interactive
+        ? RESERVED_INTERACTIVE_SLOTS : 0;
+
+    if (m_activeDownloads.size() >= qMax(1, m_maxConcurrentDownloads - reserved)) {
+        return false;
+    }
+
+    const auto host = m_hosts.constFind(download.url.host());
+    if (host == m_hosts.constEnd()) {
+        return true; // Nothing in flight to this host yet
+    }
+    return host->cooldownUntil <= now && host->stats.inFlight < qMax(1, host->stats.limit - reserved);
+}
+
+// Earliest moment a queued item stops waiting on a backoff or cooldown, 0 if none is waiting
+qint64 HttpClient::nextReadyAt(qint64 now) const {
+    qint64 readyAt = 0;
+
+    for (const auto& queue : m_downloadQueues) {
+        for (const Download& download : queue) {
+            const qint64 cooldownUntil = m_hosts.value(download.url.host()).cooldownUntil;
+            const qint64 itemReadyAt = qMax(download.notBefore, cooldownUntil);
 
-    QNetworkReply* reply = nullptr;
-    QMetaObject::invokeMethod(this, [this, &reply, request]() {
-        reply = m_networkManager->get(request);
-        }, Qt::BlockingQueuedConnection);
+            if (itemReadyAt > now && (readyAt == 0 || itemReadyAt < readyAt)) {
+                readyAt = itemReadyAt;
+            }
+        }
+    }
+    return readyAt;
+}
+
+bool HttpClient::isQueueEmpty() const {
+    for (const auto& queue : m_downloadQueues) {
+        if (!queue.isEmpty()) return false;
+    }
+    return true;
+}
+
+void HttpClient::processDownloadQueue() {
+    Download next;
+    while (m_activeDownloads.size() < m_maxConcurrentDownloads && takeNextDownload(&next)) {
+        start(next);
+    }
 
-    if (!reply) {
-        qCWarning(loggerCategory) << "Failed to create network reply for URL:" << download.url.toString();
-        emit downloadFailed(download.filePath, "Failed to create network request");
+    // Nothing else will trigger dispatch for items waiting out a backoff or cooldown
+    const qint64 now = m_clock.elapsed();
+    const qint64 readyAt = nextReadyAt(now);
+    if (readyAt > 0) {
+        const int delay = static_cast<int>(readyAt - now);
+        if (!m_wakeUpTimer->isActive() || m_wakeUpTimer->remainingTime() > delay) {
+            m_wakeUpTimer->start(delay);
+        }
+    }
+}
+
+void HttpClient::start(const Download& download) {
+    const QString filePath = resolveFilePath(download);
+    auto transfer = std::make_shared<Transfer>(download, filePath);
+    transfer->buffer.resize(STREAM_BUFFER_SIZE);
+
+    // Pick up the partial file of an interrupted attempt, if its journal still vouches for it
+    transfer->resumeOffset = loadJournal(filePath, download.url, &transfer->validators);
+    transfer->resumable = transfer->resumeOffset > 0;
+
+    const QIODevice::OpenMode mode = transfer->resumable
+        ? QIODevice::WriteOnly | QIODevice::Append
+        : QIODevice::WriteOnly | QIODevice::Truncate;
+
+    if (!transfer->file.open(mode)) {
+        qCWarning(loggerCategory) << "Failed to open file for writing:" << transfer->file.fileName() << "-" << transfer->file.errorString();
+        emit downloadFailed(filePath, "Failed to open file for writing");
+        finishUnstarted();
         return;
     }
 
-    {
-        QMutexLocker locker(&m_qMutex);
-        if (m_activeDownloads.contains(reply)) {
-            qCWarning(loggerCategory) << "Download already in progress for URL:" << download.url.toString();
-            reply->deleteLater();
-            return;
+    if (!startChecksum(transfer.get())) {
+        emit downloadFailed(filePath, "Unsupported checksum: " + QString::fromLatin1(download.options.expectedChecksum));
+        discardPartial(transfer.get());
+        finishUnstarted();
+        return;
+    }
+
+    QNetworkRequest request = createRequest(download.url);
+
+    if (transfer->resumable) {
+        qCInfo(loggerCategory) << "Resuming" << download.url.toString() << "from byte" << transfer->resumeOffset;
+
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(transfer->resumeOffset) + "-");
+        request.setRawHeader("If-Range", !transfer->validators.etag.isEmpty()
+            ? transfer->validators.etag : transfer->validators.lastModified);
+        // Ranges address the encoded body, so a resumed transfer has to stay uncompressed
+        request.setRawHeader("Accept-Encoding", "identity");
+
+    } else if (download.options.revalidate && QFileInfo::exists(filePath)) {
+        // Only revalidate against a file we still have, otherwise a 304 would leave nothing on disk
+        const Validators validators = loadValidators(filePath, download.url);
+        if (!validators.etag.isEmpty()) {
+            request.setRawHeader("If-None-Match", validators.etag);
+        }
+        if (!validators.lastModified.isEmpty()) {
+            request.setRawHeader("If-Modified-Since", validators.lastModified);
         }
-        m_activeDownloads[reply] = download;
     }
 
-    connect(reply, &QNetworkReply::downloadProgress, this, &HttpClient::onDownloadProgress, Qt::QueuedConnection);
+    QNetworkReply* reply = m_networkManager->get(request);
+    reply->setReadBufferSize(STREAM_BUFFER_SIZE);
 
-    connect(reply, &QNetworkReply::errorOccurred, this, [this, reply](QNetworkReply::NetworkError error) {
-        qCWarning(loggerCategory) << "Network error occurred:" << error << "-" << reply->errorString();
-        }, Qt::QueuedConnection);
+    transfer->key = downloadKey(download);
+    transfer->host = download.url.host();
+    transfer->elapsed.start();
+    m_activeDownloads.insert(reply, transfer);
+    m_activeByKey.insert(transfer->key, transfer);
+    m_activePaths.insert(filePath);
 
-    QTimer* timer = nullptr;
-    QMetaObject::invokeMethod(this, [&timer]() {
-        timer = new QTimer();
-        timer->setSingleShot(true);
-        }, Qt::BlockingQueuedConnection);
+    auto host = m_hosts.find(transfer->host);
+    if (host == m_hosts.end()) {
+        host = m_hosts.insert(transfer->host, HostState());
+        host->stats.limit = qBound(m_hostMinConcurrency, HOST_INITIAL_CONCURRENCY, m_hostMaxConcurrency);
+    }
+    host->stats.inFlight++;
+    m_activeCount.storeRelaxed(m_activeDownloads.size());
+
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        if (auto transfer = m_activeDownloads.value(reply)) {
+            writeChunk(reply, transfer.get());
+        }
+    });
 
-    connect(timer, &QTimer::timeout, reply, &QNetworkReply::abort, Qt::QueuedConnection);
-    connect(reply, &QNetworkReply::finished, timer, &QObject::deleteLater, Qt::QueuedConnection);
+    connect(reply, &QNetworkReply::downloadProgress, this, &HttpClient::onDownloadProgress);
 
-    QMetaObject::invokeMethod(timer, [timer]() {
-        timer->start(REQUEST_TIMEOUT_MS);
-        }, Qt::QueuedConnection);
+    // The batch ticker only runs while something is in flight and someone is listening
+    if (!m_progressTimer->isActive() && isSignalConnected(QMetaMethod::fromSignal(&HttpClient::batchProgress))) {
+        m_batchLastAt = m_clock.elapsed();
+        m_progressTimer->start();
+    }
 
-    // Wait for download 
-    QEventLoop loop;
-    connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit, Qt::QueuedConnection);
-    loop.exec();
+    connect(reply, &QNetworkReply::errorOccurred, this, [reply](QNetworkReply::NetworkError error) {
+        qCWarning(loggerCategory) << "Network error occurred:" << error << "-" << reply->errorString();
+    });
 
-    handleDownloadResult(reply);
-    QMetaObject::invokeMethod(this, [reply]() {
-        reply->deleteLater();
-        }, Qt::QueuedConnection);
+    // Timeouts surface here too: the manager's transfer timeout aborts stalled replies
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        handleDownloadResult(reply);
+    });
 }
 
 void HttpClient::handleDownloadResult(QNetworkReply* reply) {
-    QMutexLocker locker(&m_qMutex);
+    reply->deleteLater();
 
-    if (!m_activeDownloads.contains(reply)) return;
+    std::shared_ptr<Transfer> transfer = m_activeDownloads.take(reply);
+    m_activeCount.storeRelaxed(m_activeDownloads.size());
+    if (!transfer) return;
 
-    Download download = m_activeDownloads.take(reply);
-    locker.unlock();
+    m_activeByKey.remove(transfer->key);
+    m_activePaths.remove(transfer->filePath);
+    if (!reply->error()) {
+        m_batchFinishedBytes += transfer->bytesReceived;
+    }
 
+    const Download& download = transfer->download;
+    const QString& filePath = transfer->filePath;
     const QUrl url = reply->request().url();
     const int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
 
-    QString filePath = download.filePath;
-    if (filePath.isEmpty()) {
-        filePath = Pathing::getPaths()->getAddonsPath() + "/" + url.fileName();
-    }
+    const TransferOutcome outcome = classifyResult(reply, statusCode);
+    adaptHostLimit(transfer.get(), outcome);
 
-    // Helper function to emit signals in the main thread
-    auto emitSignal = [this](const QString& filePath, bool success, const QString& errorMsg = QString()) {
-        QMetaObject::invokeMethod(this, [this, filePath, success, errorMsg]() {
-            if (success) {
-                emit downloadFinished(filePath);
-            } else {
-                emit downloadFailed(filePath, errorMsg);
-            }
-        }, Qt::QueuedConnection);
-    };
+    if (statusCode == 416 && transfer->resumeOffset > 0) { // Partial file no longer matches, start over
+        discardPartial(transfer.get());
+
+        qCInfo(loggerCategory) << "Range not satisfiable, restarting" << url.toString();
+        m_downloadQueues[static_cast<int>(download.options.priority)].prepend(download);
+
+    } else if (outcome == TransferOutcome::Throttled || outcome == TransferOutcome::Failed) {
+        suspendPartial(transfer.get());
+
+        const bool throttled = outcome == TransferOutcome::Throttled;
+        const int attempts = throttled ? download.throttles : download.retries;
+        const int maxAttempts = throttled ? MAX_THROTTLE_RETRIES : MAX_RETRIES;
 
-    if (reply->error()) {
-        if (download.retries < MAX_RETRIES) {
+        if (attempts < maxAttempts) {
             qCInfo(loggerCategory) << "Retrying download for" << url.toString()
-                << "Attempt" << (download.retries + 1) << "of" << MAX_RETRIES;
-            retryDownload(download);
-            return;
+                << "Attempt" << (attempts + 1) << "of" << maxAttempts << (throttled ? "(throttled)" : "");
+            retryDownload(download, outcome, retryAfterMs(reply));
+        } else {
+            // Download failed
+            QString errorMsg = statusCode > 0
+                ? QString("HTTP error %1 after %2 retries: %3").arg(statusCode).arg(attempts)
+                    .arg(reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString())
+                : QString("Network error after %1 retries: %2").arg(attempts).arg(reply->errorString());
+            emit downloadFailed(filePath, errorMsg);
         }
 
-        // Download failed
-        QString errorMsg = QString("Network error after %1 retries: %2")
-            .arg(download.retries).arg(reply->errorString());
-        emitSignal(filePath, false, errorMsg);
+    } else if (outcome == TransferOutcome::Fatal) {
+        discardPartial(transfer.get());
+
+        QString errorMsg = statusCode >= 300
+            ? QString("HTTP error %1: %2").arg(statusCode)
+                .arg(reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString())
+            : QString("Network error: %1").arg(reply->errorString());
+        emit downloadFailed(filePath, errorMsg);
 
-    } else if (statusCode >= 400) { // HTTP error
-        QString errorMsg = QString("HTTP error %1: %2")
-            .arg(statusCode).arg(reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString());
-        emitSignal(filePath, false, errorMsg);
+    } else if (statusCode == 304) { // Not modified, keep the existing file untouched
+        discardPartial(transfer.get());
+
+        qCInfo(loggerCategory) << "Not modified, reusing" << filePath;
+        emit downloadNotModified(filePath);
 
     } else { // Success
-        if (saveToDisk(filePath, reply)) {
-            emitSignal(filePath, true);
+        if (saveToDisk(reply, transfer.get())) {
+            if (download.options.revalidate) {
+                saveValidators(filePath, reply);
+            }
+            reportStats(reply, transfer.get());
+            emit downloadFinished(filePath);
+        } else if (transfer->checksumMismatch && download.retries < MAX_RETRIES) {
+            qCInfo(loggerCategory) << "Retrying corrupted download for" << url.toString()
+                << "Attempt" << (download.retries + 1) << "of" << MAX_RETRIES;
+            retryDownload(download, TransferOutcome::Failed, -1);
         } else {
-            emitSignal(filePath, false, "Failed to save file");
+            emit downloadFailed(filePath, transfer->checksumMismatch ? "Checksum mismatch" : "Failed to save file");
         }
     }
+
+    checkDownloadQueue();
+}
+
+// Location will be given by caller, otherwise falls back to the AddOns directory
+QString HttpClient::resolveFilePath(const Download& download) const {
+    if (!download.filePath.isEmpty()) {
+        return download.filePath;
+    }
+    return Pathing::getPaths()->getAddonsPath() + "/" + download.url.fileName();
 }
 
-// Location will be given by caller
-bool HttpClient::saveToDisk(const QString& filename, QIODevice* data) {
-    QSaveFile file(filename);
+QString HttpClient::validatorsPath(const QString& filePath) const {
+    return filePath + ".meta";
+}
+
+HttpClient::Validators HttpClient::loadValidators(const QString& filePath, const QUrl& url) const {
+    QFile file(validatorsPath(filePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return {};
+    }
 
+    const QJsonObject json = QJsonDocument::fromJson(file.readAll()).object();
+    if (json["url"].toString() != url.toString()) {
+        return {}; // Validators belong to a different resource
+    }
+
+    return { json["etag"].toString().toUtf8(), json["lastModified"].toString().toUtf8() };
+}
+
+void HttpClient::saveValidators(const QString& filePath, QNetworkReply* reply) const {
+    QJsonObject json;
+    json["url"] = reply->url().toString();
+    json["etag"] = QString::fromUtf8(reply->rawHeader("ETag"));
+    json["lastModified"] = QString::fromUtf8(reply->rawHeader("Last-Modified"));
+
+    QSaveFile file(validatorsPath(filePath));
     if (!file.open(QIODevice::WriteOnly)) {
-        qCWarning(loggerCategory) << "Failed to open file for writing: " << filename;
+        qCWarning(loggerCategory) << "Failed to save validators for" << filePath << "-" << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        qCWarning(loggerCategory) << "Failed to commit validators for" << filePath << "-" << file.errorString();
+    }
+}
+
+QString HttpClient::journalPath(const QString& filePath) const {
+    return filePath + ".part.json";
+}
+
+// Returns how many bytes of the part file can be resumed from, 0 if it has to start over
+qint64 HttpClient::loadJournal(const QString& filePath, const QUrl& url, Validators* validators) const {
+    const QString partPath = filePath + ".part";
+
+    QFile journal(journalPath(filePath));
+    if (!journal.open(QIODevice::ReadOnly)) {
+        QFile::remove(partPath); // A part file without a journal cannot be trusted
+        return 0;
+    }
+
+    const QJsonObject json = QJsonDocument::fromJson(journal.readAll()).object();
+    journal.close();
+
+    const qint64 offset = json["offset"].toInteger();
+    *validators = { json["etag"].toString().toUtf8(), json["lastModified"].toString().toUtf8() };
+
+    const bool valid = json["url"].toString() == url.toString()
+        && offset > 0
+        && QFileInfo(partPath).size() >= offset
+        && (!validators->etag.isEmpty() || !validators->lastModified.isEmpty());
+
+    // Anything past the journalled offset was written after the last checkpoint
+    if (!valid || !QFile::resize(partPath, offset)) {
+        QFile::remove(partPath);
+        journal.remove();
+        *validators = {};
+        return 0;
+    }
+    return offset;
+}
+
+void HttpClient::saveJournal(const Transfer* transfer) const {
+    QJsonObject json;
+    json["url"] = transfer->download.url.toString();
+    json["offset"] = QFileInfo(transfer->file.fileName()).size();
+    json["etag"] = QString::fromUtf8(transfer->validators.etag);
+    json["lastModified"] = QString::fromUtf8(transfer->validators.lastModified);
+
+    QSaveFile journal(journalPath(transfer->filePath));
+    if (!journal.open(QIODevice::WriteOnly)) {
+        qCWarning(loggerCategory) << "Failed to save resume journal for" << transfer->filePath << "-" << journal.errorString();
+        return;
+    }
+    journal.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+    journal.commit();
+}
+
+// Keeps what has been received so the next attempt can resume, when the server allows it
+void HttpClient::suspendPartial(Transfer* transfer) const {
+    transfer->file.close();
+
+    if (transfer->resumable && !transfer->failed && transfer->file.size() > 0) {
+        saveJournal(transfer);
+    } else {
+        discardPartial(transfer);
+    }
+}
+
+void HttpClient::discardPartial(Transfer* transfer) const {
+    transfer->file.close();
+    transfer->file.remove();
+    QFile::remove(journalPath(transfer->filePath));
+}
+
+bool HttpClient::checksumAlgorithm(const QByteArray& checksum, QCryptographicHash::Algorithm* algorithm) {
+    QCryptographicHash::Algorithm found;
+    switch (checksum.size()) {
+    case 32: found = QCryptographicHash::Md5; break;
+    case 40: found = QCryptographicHash::Sha1; break;
+    case 64: found = QCryptographicHash::Sha256; break;
+    case 128: found = QCryptographicHash::Sha512; break;
+    default: return false;
+    }
+
+    for (const char c : checksum) {
+        if (!std::isxdigit(static_cast<unsigned char>(c))) return false;
+    }
+    if (algorithm) *algorithm = found;
+    return true;
+}
+
+// Hashing happens as bytes stream to disk. A resumed transfer first replays the part file it
+// continues, which is the only time verification reads anything back.
+bool HttpClient::startChecksum(Transfer* transfer) {
+    const QByteArray& expected = transfer->download.options.expectedChecksum;
+    if (expected.isEmpty()) return true;
+
+    QCryptographicHash::Algorithm algorithm;
+    if (!checksumAlgorithm(expected, &algorithm)) {
+        qCWarning(loggerCategory) << "Unrecognised checksum for" << transfer->filePath << ":" << expected;
         return false;
     }
+    transfer->hash = std::make_unique<QCryptographicHash>(algorithm);
 
-    try {
-        QNetworkReply* reply = qobject_cast<QNetworkReply*>(data);
-        QByteArray content;
+    if (transfer->resumeOffset > 0) {
+        QFile part(transfer->file.fileName());
+        qint64 remaining = part.open(QIODevice::ReadOnly) ? transfer->resumeOffset : -1;
 
-        if (reply) {
-            //// Check if the response is compressed
-            //QByteArray encoding = reply->rawHeader("Content-Encoding");
-            //QByteArray contentType = reply->rawHeader("Content-Type");
-            //qCDebug(loggerCategory) << "Content-Encoding:" << encoding;
-            //qCDebug(loggerCategory) << "Content-Type:" << contentType;
-            content = reply->readAll();
+        while (remaining > 0) {
+            const qint64 bytesRead = part.read(transfer->buffer.data(), qMin<qint64>(remaining, transfer->buffer.size()));
+            if (bytesRead <= 0) break;
+
+            transfer->hash->addData(QByteArrayView(transfer->buffer.constData(), bytesRead));
+            remaining -= bytesRead;
         }
 
-        if (content.isEmpty() && data->size() > 0) {
-            qCWarning(loggerCategory) << "Empty content received for non-empty data source";
-            return false;
+        // Unreadable part file, fall back to a full fetch
+        if (remaining != 0) {
+            transfer->hash->reset();
+            transfer->file.resize(0);
+            transfer->resumeOffset = 0;
+            transfer->resumable = false;
         }
+    }
+    return true;
+}
 
-        qint64 bytesWritten = file.write(content);
-        if (bytesWritten != content.size()) {
-            qCWarning(loggerCategory) << "Failed to write all data:" << bytesWritten << "of" << content.size();
-            file.cancelWriting();
-            return false;
+// Decides on the response headers whether the body continues the part file or replaces it
+void HttpClient::checkResponse(QNetworkReply* reply, Transfer* transfer) {
+    if (transfer->headersChecked) return;
+    transfer->headersChecked = true;
+    transfer->firstByteMs = transfer->elapsed.elapsed();
+
+    const int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (statusCode >= 300) return; // Redirect, error and 304 bodies are never written
+
+    if (transfer->resumeOffset > 0 && (statusCode != 206 || contentRangeStart(reply) != transfer->resumeOffset)) {
+        qCInfo(loggerCategory) << "Server refused to resume" << transfer->filePath << "- fetching it in full";
+        transfer->file.resize(0);
+        transfer->resumeOffset = 0;
+        if (transfer->hash) {
+            transfer->hash->reset();
         }
+    }
 
-        if (!file.commit()) {
-            qCWarning(loggerCategory) << "Failed to commit file:" << filename;
-            return false;
+    // Weak ETags cannot be used with If-Range
+    Validators validators;
+    const QByteArray etag = reply->rawHeader("ETag");
+    if (!etag.startsWith("W/")) {
+        validators.etag = etag;
+    }
+    validators.lastModified = reply->rawHeader("Last-Modified");
+
+    if (!validators.etag.isEmpty() || !validators.lastModified.isEmpty()) {
+        transfer->validators = validators;
+    }
+
+    if (transfer->download.options.sink) {
+        transfer->download.options.sink->begin(transfer->file.fileName(), transfer->resumeOffset);
+    }
+
+    const QByteArray encoding = reply->rawHeader("Content-Encoding").trimmed().toLower();
+    if (encoding == "gzip" || encoding == "x-gzip" || encoding == "deflate") {
+        transfer->decoder = std::make_unique<Decoder>();
+    } else if (!encoding.isEmpty() && encoding != "identity") {
+        qCWarning(loggerCategory) << "Unsupported Content-Encoding" << encoding << "for" << transfer->filePath;
+        transfer->failed = true;
+    }
+
+    transfer->resumable = (statusCode == 206 || reply->rawHeader("Accept-Ranges").contains("bytes"))
+        && !transfer->decoder
+        && (!transfer->validators.etag.isEmpty() || !transfer->validators.lastModified.isEmpty());
+}
+
+// Drains whatever the reply has buffered into the part file, one fixed-size chunk at a time
+void HttpClient::writeChunk(QNetworkReply* reply, Transfer* transfer) {
+    const int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    checkResponse(reply, transfer);
+
+    while (reply->bytesAvailable() > 0) {
+        const qint64 bytesRead = reply->read(transfer->buffer.data(), transfer->buffer.size());
+        if (bytesRead <= 0) break;
+
+        // Redirect, error and 304 bodies and failed streams are drained but never written
+        if (transfer->failed || statusCode >= 300) continue;
+        transfer->wireBytes += bytesRead;
+
+        Decoder* decoder = transfer->decoder.get();
+        if (!decoder) {
+            writeBody(transfer, transfer->buffer.constData(), bytesRead);
+            continue;
         }
-    } catch (const std::exception& e) {
-        //emit downloadFailed(filename, QString("Failed to write to file: %1 due to: %2").arg(filename).arg(e.what()));
-        emit downloadFailed(filename, QString("Failed to write file: %1").arg(e.what()));
-        qCCritical(loggerCategory) << "Failed to write to file: " << filename << " - " << e.what();
+        if (decoder->finished) continue; // Trailing bytes after the compressed stream
+
+        z_stream& stream = decoder->stream;
+        stream.next_in = reinterpret_cast<Bytef*>(transfer->buffer.data());
+        stream.avail_in = uInt(bytesRead);
+        do {
+            stream.next_out = reinterpret_cast<Bytef*>(decoder->output.data());
+            stream.avail_out = uInt(decoder->output.size());
+
+            const int status = decoder->ok ? ::inflate(&stream, Z_NO_FLUSH) : Z_STREAM_ERROR;
+            if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+                qCWarning(loggerCategory) << "Corrupt compressed body for" << transfer->filePath << "(zlib" << status << ")";
+                transfer->failed = true;
+                break;
+            }
+            writeBody(transfer, decoder->output.constData(), decoder->output.size() - stream.avail_out);
+            decoder->finished = status == Z_STREAM_END;
+        } while (!decoder->finished && !transfer->failed && (stream.avail_in > 0 || stream.avail_out == 0));
+    }
+}
+
+// Decoded body bytes go to the part file, the checksum and the sink alike
+void HttpClient::writeBody(Transfer* transfer, const char* data, qint64 size) {
+    if (size <= 0) return;
 
-        file.cancelWriting();
+    const qint64 bytesWritten = transfer->file.write(data, size);
+    transfer->decodedBytes += qMax<qint64>(bytesWritten, 0);
+    if (transfer->hash) {
+        transfer->hash->addData(QByteArrayView(data, size));
+    }
+    if (transfer->download.options.sink) {
+        transfer->download.options.sink->write(data, size);
+    }
+    if (bytesWritten != size) {
+        qCWarning(loggerCategory) << "Failed to write all data:" << bytesWritten << "of" << size
+            << "to" << transfer->filePath;
+        transfer->failed = true;
+    }
+}
+
+bool HttpClient::saveToDisk(QNetworkReply* reply, Transfer* transfer) {
+    writeChunk(reply, transfer);
+
+    if (transfer->decoder && !transfer->decoder->finished && transfer->wireBytes > 0) {
+        qCWarning(loggerCategory) << "Compressed body ended early for" << transfer->filePath;
+        transfer->failed = true;
+    }
+
+    if (transfer->failed || !transfer->file.flush()) {
+        qCWarning(loggerCategory) << "Failed to write file:" << transfer->filePath << "-" << transfer->file.errorString();
+        discardPartial(transfer);
         return false;
-    } catch (...) {
-        emit downloadFailed(filename, "Unknown error while writing file");
-        qCCritical(loggerCategory) << "Unknown exception while writing file:" << filename;
+    }
+    transfer->file.close();
+
+    // Verified before the rename, so a corrupted archive never takes the target's place
+    if (transfer->hash) {
+        const QByteArray actual = transfer->hash->result().toHex();
+        if (actual != transfer->download.options.expectedChecksum.toLower()) {
+            qCWarning(loggerCategory) << "Checksum mismatch for" << transfer->filePath
+                << "expected" << transfer->download.options.expectedChecksum << "got" << actual;
+            transfer->checksumMismatch = true;
+            discardPartial(transfer);
+            return false;
+        }
+    }
 
-        file.cancelWriting();
+    if (!replaceFile(transfer->file.fileName(), transfer->filePath)) {
+        discardPartial(transfer);
         return false;
     }
+    QFile::remove(journalPath(transfer->filePath));
     return true;
 }
 
+// Bodies are decoded by writeChunk(), so the bytes read from the reply are the compressed size
+void HttpClient::reportStats(QNetworkReply* reply, const Transfer* transfer) {
+    DownloadStats stats;
+    stats.contentEncoding = reply->rawHeader("Content-Encoding");
+    stats.wireBytes = transfer->wireBytes;
+    stats.decodedBytes = transfer->decodedBytes;
+    stats.elapsedMs = transfer->elapsed.elapsed();
+
+    const bool identity = stats.contentEncoding.isEmpty() || stats.contentEncoding.compare("identity", Qt::CaseInsensitive) == 0;
+    qCInfo(loggerCategory) << "Downloaded" << transfer->filePath
+        << "encoding:" << (identity ? QByteArray("identity") : stats.contentEncoding)
+        << "wire:" << stats.wireBytes << "decoded:" << stats.decodedBytes << "in" << stats.elapsedMs << "ms";
+
+    emit downloadStats(transfer->filePath, stats);
+}
+
+// Runs for every network chunk, so it only records numbers; signals go out at PROGRESS_INTERVAL_MS
+// at most, plus once on completion, and not at all when nothing is connected
 void HttpClient::onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal) {
     QNetworkReply* reply = qobject_cast<QNetworkReply*>(sender());
-    QString filePath;
 
-    {
-        QMutexLocker locker(&m_qMutex);
-        if (reply && m_activeDownloads.contains(reply)) {
-            //emit downloadProgress(m_activeDownloads[reply].filePath, bytesReceived, bytesTotal);
-            filePath = m_activeDownloads[reply].filePath;
+    const auto it = m_activeDownloads.constFind(reply);
+    if (it == m_activeDownloads.constEnd()) {
+        qCWarning(loggerCategory) << "Download progress received for unknown reply";
+        return;
+    }
+    Transfer* transfer = it->get();
+
+    // Progress covers the whole file, including what a resumed attempt already had on disk
+    const qint64 offset = transfer->resumeOffset;
+    transfer->bytesReceived = offset + bytesReceived;
+    transfer->bytesTotal = bytesTotal < 0 ? bytesTotal : offset + bytesTotal;
+
+    if (!isSignalConnected(QMetaMethod::fromSignal(&HttpClient::downloadProgress))) return;
+
+    const qint64 now = m_clock.elapsed();
+    const bool complete = transfer->bytesReceived == transfer->bytesTotal;
+    if (!complete && transfer->lastProgressAt >= 0 && now - transfer->lastProgressAt < PROGRESS_INTERVAL_MS) return;
+
+    transfer->lastProgressAt = now;
+    emit downloadProgress(transfer->filePath, transfer->bytesReceived, transfer->bytesTotal);
+}
+
+// Totals cover finished and in-flight transfers of the current batch; queued items have no size yet
+void HttpClient::reportBatchProgress() {
+    qint64 received = m_batchFinishedBytes;
+    qint64 total = m_batchFinishedBytes;
+    bool totalKnown = true;
+
+    for (const auto& transfer : std::as_const(m_activeDownloads)) {
+        received += transfer->bytesReceived;
+        if (transfer->bytesTotal < 0) {
+            totalKnown = false;
+        } else {
+            total += transfer->bytesTotal;
         }
-        else {
-            qCWarning(loggerCategory) << "Download progress received for unknown reply";
-            return;
+    }
+
+    const qint64 now = m_clock.elapsed();
+    const qint64 elapsedMs = now - m_batchLastAt;
+    if (elapsedMs > 0) {
+        const double rate = qMax<qint64>(0, received - m_batchLastBytes) * 1000.0 / elapsedMs;
+        m_batchRate = m_batchRate > 0 ? m_batchRate + 0.3 * (rate - m_batchRate) : rate;
+    }
+    m_batchLastBytes = received;
+    m_batchLastAt = now;
+
+    const qint64 eta = totalKnown && m_batchRate > 0
+        ? qint64((total - received) * 1000.0 / m_batchRate)
+        : -1;
+
+    emit batchProgress(received, totalKnown ? total : -1, m_batchRate, eta);
+}
+
+// Throttling pauses the whole host, so every queued request to it waits out the same cooldown
+// instead of each one probing the server on its own schedule
+void HttpClient::retryDownload(const Download& download, TransferOutcome outcome, qint64 retryAfter) {
+    Download retry = download;
+    const qint64 now = m_clock.elapsed();
+
+    if (outcome == TransferOutcome::Throttled) {
+        retry.throttles++;
+        const qint64 delay = retryAfter >= 0 ? retryAfter : backoffDelayMs(retry.throttles);
+
+        HostState& host = m_hosts[retry.url.host()];
+        if (now + delay > host.cooldownUntil) {
+            host.cooldownUntil = now + delay;
+            host.stats.decision = QString("cooldown for %1 ms%2").arg(delay)
+                .arg(retryAfter >= 0 ? " (Retry-After)" : "");
+
+            qCInfo(loggerCategory) << "Host" << retry.url.host() << host.stats.decision;
+            emit hostStatsChanged(retry.url.host(), host.stats);
         }
+    } else {
+        retry.retries++;
+        retry.notBefore = now + (retryAfter >= 0 ? retryAfter : backoffDelayMs(retry.retries));
     }
 
-    emit downloadProgress(filePath, bytesReceived, bytesTotal);
+    enqueue(retry);
 }
 
-void HttpClient::retryDownload(const Download& download) {
-    Download retryDownload = download;
+// Exponential backoff with equal jitter: half the window is guaranteed, the other half random,
+// so a batch of failures does not come back in lockstep
+qint64 HttpClient::backoffDelayMs(int attempt) const {
+    const qint64 window = qMin<qint64>(RETRY_MAX_DELAY_MS, qint64(RETRY_BASE_DELAY_MS) << qBound(0, attempt - 1, 16));
+    return window / 2 + QRandomGenerator::global()->bounded(window / 2 + 1);
+}
 
-    retryDownload.retries++;
+// Retry-After as delta-seconds or an HTTP date, -1 when absent or unreadable
+qint64 HttpClient::retryAfterMs(QNetworkReply* reply) const {
+    const QByteArray value = reply->rawHeader("Retry-After").trimmed();
+    if (value.isEmpty()) return -1;
+
+    bool ok = false;
+    qint64 delay = value.toLongLong(&ok) * 1000;
+    if (!ok) {
+        const QDateTime date = QDateTime::fromString(QString::fromLatin1(value), Qt::RFC2822Date);
+        if (!date.isValid()) return -1;
+        delay = QDateTime::currentDateTimeUtc().msecsTo(date);
+    }
+    return qBound<qint64>(0, delay, RETRY_AFTER_MAX_MS);
+}
 
-    QTimer::singleShot(1000 * retryDownload.retries, this, [this, retryDownload]() {
-        QMutexLocker locker(&m_qMutex);
-        m_downloadQueue.enqueue(retryDownload);
-        locker.unlock();
-        checkDownloadQueue();
-    });
+HttpClient::TransferOutcome HttpClient::classifyResult(QNetworkReply* reply, int statusCode) const {
+    if (statusCode == 429 || statusCode == 503) {
+        return TransferOutcome::Throttled;
+    }
+    if (statusCode == 408 || statusCode == 500 || statusCode == 502 || statusCode == 504) {
+        return TransferOutcome::Failed;
+    }
+    // A final redirect is one Qt declined to follow; its body is not the file either
+    if (statusCode >= 400 || (statusCode >= 300 && statusCode != 304)) {
+        return TransferOutcome::Fatal;
+    }
+
+    switch (reply->error()) {
+    case QNetworkReply::NoError:
+        return TransferOutcome::Success;
+    // Connection-level trouble that a later attempt can get past
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::OperationCanceledError: // Transfer timeout
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::ProxyConnectionClosedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::UnknownServerError:
+        return TransferOutcome::Failed;
+    default:
+        return TransferOutcome::Fatal;
+    }
 }
 
-void HttpClient::setMaxConcurrentDownloads(int max) {
-    {
-        QMutexLocker locker(&m_qMutex);
-        m_maxConcurrentDownloads = qMax(1, max);
+static double ewma(double average, double sample) {
+    return average + HOST_EWMA_WEIGHT * (sample - average);
+}
+
+// AIMD: one more slot after a window of clean completions that actually used the limit, half the
+// slots on throttling or failures. Rising time to first byte means the host is queueing us, so
+// growth holds there instead of waiting for the server to start refusing.
+void HttpClient::adaptHostLimit(const Transfer* transfer, TransferOutcome outcome) {
+    HostState& host = m_hosts[transfer->host];
+    HostStats& stats = host.stats;
+    stats.inFlight = qMax(0, stats.inFlight - 1);
+
+    if (outcome == TransferOutcome::Fatal) return;
+
+    const int previousLimit = stats.limit;
+    stats.errorRate = ewma(stats.errorRate, outcome == TransferOutcome::Success ? 0.0 : 1.0);
+
+    if (outcome == TransferOutcome::Success) {
+        const qint64 elapsedMs = qMax<qint64>(1, transfer->elapsed.elapsed());
+        const double throughput = transfer->decodedBytes * 1000.0 / elapsedMs;
+        const double latencyMs = transfer->firstByteMs >= 0 ? transfer->firstByteMs : elapsedMs;
+
+        stats.throughput = stats.throughput > 0 ? ewma(stats.throughput, throughput) : throughput;
+        stats.latencyMs = stats.latencyMs > 0 ? ewma(stats.latencyMs, latencyMs) : latencyMs;
+        host.baselineLatencyMs = host.baselineLatencyMs > 0 ? qMin(host.baselineLatencyMs, latencyMs) : latencyMs;
+
+        if (stats.latencyMs > host.baselineLatencyMs * HOST_LATENCY_CONGESTION) {
+            host.successes = 0;
+            stats.decision = QString("hold at %1: latency %2 ms vs %3 ms baseline")
+                .arg(stats.limit).arg(qRound(stats.latencyMs)).arg(qRound(host.baselineLatencyMs));
+        } else if (++host.successes >= stats.limit && stats.inFlight + 1 >= stats.limit
+            && stats.limit < m_hostMaxConcurrency) {
+            host.successes = 0;
+            stats.limit++;
+            stats.decision = QString("increase to %1: %2 KiB/s per transfer")
+                .arg(stats.limit).arg(qRound(stats.throughput / 1024));
+        }
+    } else {
+        if (outcome == TransferOutcome::Throttled) {
+            stats.throttled++;
+        }
 
-        m_threadPool->setMaxThreadCount(m_maxConcurrentDownloads);
+        const qint64 now = m_clock.elapsed();
+        if (host.lastDecreaseAt < 0 || now - host.lastDecreaseAt >= HOST_DECREASE_WINDOW_MS) {
+            host.lastDecreaseAt = now;
+            host.successes = 0;
+            stats.limit = qMax(m_hostMinConcurrency, stats.limit / 2);
+            stats.decision = QString("decrease to %1: %2").arg(stats.limit)
+                .arg(outcome == TransferOutcome::Throttled ? "throttled by server" : "transfer failed");
+        }
     }
-    checkDownloadQueue();
+
+    if (stats.limit != previousLimit) {
+        qCInfo(loggerCategory) << "Host" << transfer->host << stats.decision
+            << "- error rate" << stats.errorRate << "in flight" << stats.inFlight;
+        emit hostStatsChanged(transfer->host, stats);
+    }
+}
+
+void HttpClient::setConcurrencyBounds(int minPerHost, int maxPerHost) {
+    QMetaObject::invokeMethod(this, [this, minPerHost, maxPerHost]() {
+        m_hostMinConcurrency = qMax(1, minPerHost);
+        m_hostMaxConcurrency = qMax(m_hostMinConcurrency, maxPerHost);
+
+        for (HostState& host : m_hosts) {
+            host.stats.limit = qBound(m_hostMinConcurrency, host.stats.limit, m_hostMaxConcurrency);
+        }
+        processDownloadQueue();
+    }, Qt::QueuedConnection);
+}
+
+void HttpClient::setMaxConcurrentDownloads(int max) {
+    QMetaObject::invokeMethod(this, [this, max]() {
+        m_maxConcurrentDownloads = qMax(1, max);
+        processDownloadQueue();
+    }, Qt::QueuedConnection);
 }
 
 int HttpClient::activeDownloads() const {
-    QMutexLocker locker(&m_qMutex);
-    return m_activeDownloads.size();
+    return m_activeCount.loadRelaxed();
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "manager.h"
 #include "logger.h"
 #include "pathing.h"
+#include "catalog_parser.h"
+#include "catalog_snapshot.h"
 
 #include <QFile>
 #include <QTextStream>
@@ -10,23 +12,62 @@
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
-#include <QFileInfo>   
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDirIterator>
+#include <QThreadPool>
+#include <QRandomGenerator>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <utility>
+
+// Runs catalog loads one at a time. They wait on decoding spread over the global pool, so they
+// must not occupy a global pool thread themselves
+Q_GLOBAL_STATIC(QThreadPool, catalogPool)
 
 Manager::Manager(QObject* parent)
-    : QObject(parent), httpClient(new HttpClient(4, this)) {
+    : QObject(parent), httpClient(new HttpClient(32)), m_networkThread(new QThread(this)),
+      m_archiveCache(Pathing::getPaths()->getAppDataPath() + "/archives") {
 
     m_pathing = Pathing::getPaths();
     m_addonsDir = QDir(m_pathing->getAddonsPath());
 
+    catalogPool()->setMaxThreadCount(1);
+
+    recoverStaging();
+
+    // All network work runs on its own thread; results arrive here as queued signals.
+    // The client cap is generous, per-host limits adapt to what the server tolerates
+    m_networkThread->setObjectName("esomm-network");
+    httpClient->moveToThread(m_networkThread);
+    connect(m_networkThread, &QThread::finished, httpClient, &QObject::deleteLater);
+    m_networkThread->start();
+
     loadInstalledModsCache();
 
-    connect(httpClient, &HttpClient::downloadFinished,
+    connect(httpClient, &HttpClient::downloadFinished, this,
         [this](const QString& filePath) {
             qCInfo(loggerCategory) << "Download completed:" << filePath;
 
             QString masterJsonPath = m_pathing->getAppDataPath() + "/master.json";
             if (filePath == masterJsonPath) {
                 parseAvailableMods(masterJsonPath);
+            } else if (m_pendingArchives.contains(filePath)) {
+                const QList<PendingArchive> pendings = m_pendingArchives.take(filePath);
+                if (!pendings.first().checksum.isEmpty()) {
+                    m_archiveCache.insert(pendings.first().checksum);
+                }
+                for (const PendingArchive& pending : pendings) {
+                    if (pending.extractor) {
+                        // Entries were extracted while the archive downloaded, only the tail is left to drain
+                        pending.extractor->finish(this, [this, pending](const ArchiveExtractor::Result& result) {
+                            finishInstall(pending, result);
+                        });
+                    } else {
+                        extractArchive(pending);
+                    }
+                }
             } else {
                 // Extract mod ID from the file path
                 QFileInfo fileInfo(filePath);
@@ -36,20 +77,46 @@ Manager::Manager(QObject* parent)
             }
         });
 
-    connect(httpClient, &HttpClient::downloadFailed,
+    // Catalog unchanged on the server: keep what is already parsed, only read the local copy on a cold start
+    connect(httpClient, &HttpClient::downloadNotModified, this,
+        [this](const QString& filePath) {
+            QString masterJsonPath = m_pathing->getAppDataPath() + "/master.json";
+            if (filePath != masterJsonPath) return;
+
+            if (!isCatalogCurrent(masterJsonPath)) {
+                parseAvailableMods(masterJsonPath);
+            } else {
+                qCInfo(loggerCategory) << "Master mod list not modified, keeping" << mods.size() << "parsed mods";
+            }
+        });
+
+    connect(httpClient, &HttpClient::downloadFailed, this,
         [this](const QString& filePath, const QString& error) {
             qCWarning(loggerCategory) << "Download failed:" << filePath << "-" << error;
 
             QString masterJsonPath = m_pathing->getAppDataPath() + "/master.json";
             if (filePath == masterJsonPath) {
                 QFile existingFile(masterJsonPath);
-                if (existingFile.exists()) {
+                if (isCatalogCurrent(masterJsonPath)) {
+                    qCInfo(loggerCategory) << "Keeping the catalog decoded from the existing master mod list";
+                } else if (existingFile.exists()) {
                     parseAvailableMods(masterJsonPath);
                 } else {
                     qCWarning(loggerCategory) << "No existing master mod list available";
                     emit availableModsChanged();
                 }
-            } else { // Mod download failed
+            } else if (m_pendingArchives.contains(filePath)) { // Mod download failed
+                for (PendingArchive pending : m_pendingArchives.take(filePath)) {
+                    if (pending.extractor) {
+                        pending.extractor->cancel();
+                    }
+                    pending.streamed = false; // Whatever is at the path now is not this download
+
+                    ArchiveExtractor::Result result;
+                    result.error = error;
+                    finishInstall(pending, result);
+                }
+            } else {
                 QFileInfo fileInfo(filePath);
                 QString modId = fileInfo.baseName();
 
@@ -58,6 +125,25 @@ Manager::Manager(QObject* parent)
         });
 }
 
+Manager::~Manager() {
+    m_networkThread->quit();
+    m_networkThread->wait();
+
+    if (m_catalogCancel) {
+        m_catalogCancel->store(true);
+    }
+    catalogPool()->waitForDone();
+
+    // Extractions still running would report back to a deleted Manager
+    m_extractionQueue.clear();
+    for (const std::shared_ptr<ArchiveExtractor>& extractor : std::as_const(m_installing)) {
+        if (extractor) {
+            extractor->cancel();
+        }
+    }
+    QThreadPool::globalInstance()->waitForDone();
+}
+
 bool operator==(const ModInfo &a, const QString &b) {
     return a.title == b;
 }
@@ -65,39 +151,84 @@ bool operator==(const ModInfo& a, const ModInfo& b) {
     return a.title == b.title;
 }
 
+// Reading every manifest runs on the catalog job thread, after any catalog load queued before it;
+// installedModsChanged follows once the result is applied. A newer scan supersedes one in flight
 void Manager::scanInstalledMods() {
-    qCInfo(loggerCategory) << "Scanning installed mods in: " << m_addonsDir.absolutePath();
+    const QString addonsPath = m_addonsDir.absolutePath();
+    const quint64 generation = ++m_scanGeneration;
+    qCInfo(loggerCategory) << "Scanning installed mods in: " << addonsPath;
+
+    auto* watcher = new QFutureWatcher<QList<InstalledFolder>>(this);
+    connect(watcher, &QFutureWatcher<QList<InstalledFolder>>::finished, this, [this, watcher, generation]() {
+        watcher->deleteLater();
+        if (generation != m_scanGeneration) return;
+
+        applyInstalledScan(watcher->future().takeResult());
+    });
+
+    watcher->setFuture(QtConcurrent::run(catalogPool(), [addonsPath]() {
+        if (!QDir(addonsPath).exists()) {
+            qCWarning(loggerCategory) << "AddOns directory does not exist: " << addonsPath;
+            return QList<InstalledFolder>();
+        }
+        return scanAddonsDir(addonsPath);
+    }));
+}
 
-    if (!installedMods.isEmpty()) {
-        installedMods.clear();
+// "## AddOnVersion: 123" from the addon's manifest, -1 when it has none
+static int manifestAddOnVersion(const QDir& directory) {
+    for (const QString& extension : { ".addon", ".txt" }) {
+        QFile manifest(directory.absoluteFilePath(directory.dirName() + extension));
+        if (!manifest.open(QIODevice::ReadOnly | QIODevice::Text)) continue;
+
+        while (!manifest.atEnd()) {
+            const QByteArray line = manifest.readLine().trimmed();
+            if (line.startsWith("## AddOnVersion:")) {
+                bool ok = false;
+                const int version = line.mid(16).trimmed().toInt(&ok);
+                return ok ? version : -1;
+            }
+        }
+        return -1;
     }
-    if (!m_addonsDir.exists()) {
-        qCWarning(loggerCategory) << "AddOns directory does not exist: " << m_addonsDir.absolutePath();
-        emit installedModsChanged();
-        return;
+    return -1;
+}
+
+// All the disk access of a scan, touches no Manager state so it can run on a worker thread
+QList<Manager::InstalledFolder> Manager::scanAddonsDir(const QString& addonsPath) {
+    QList<InstalledFolder> folders;
+    const QDir addonsDir(addonsPath);
+
+    for (const QString& subDir : addonsDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        const QDir modDir(addonsDir.absoluteFilePath(subDir));
+
+        InstalledFolder folder;
+        folder.name = modDir.dirName();
+        folder.path = modDir.absolutePath();
+        folder.addOnVersion = manifestAddOnVersion(modDir);
+        folders.append(folder);
     }
+    return folders;
+}
 
-    QStringList subDirs = m_addonsDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+void Manager::applyInstalledScan(const QList<InstalledFolder>& folders) {
+    // Folders removed since the last scan are no longer installed
+    mods.clearFlags(CatalogStore::Installed | CatalogStore::HasUpdate);
+    m_installedFolders.clear();
     int numInstalled = 0;
 
-    for (const QString& subDir : subDirs) {
-        QDir modDir(m_addonsDir.absoluteFilePath(subDir));
-        const QString modName = modDir.dirName();
-        const QString modPath = modDir.absolutePath();
+    for (const InstalledFolder& folder : folders) {
+        m_installedFolders.insert(folder.name, folder);
 
-        for (int i = 0; i < mods.size(); i++) {
-            if (mods[i].title == modName) {
-                mods[i].isInstalled = true;
-                mods[i].installPath = modPath;
-                qCInfo(loggerCategory) << "Found installed mod:" << mods[i].title << "at" << mods[i].installPath;
-                installedMods[modName] = &mods[i];
+        // A mod shipping several folders is installed at the one named after it
+        const int row = catalogRowForFolder(folder.name);
+        if (row < 0 || (mods.hasFlags(row, CatalogStore::Installed) && folder.name != mods.title(row))) continue;
 
-                numInstalled++;
-                break;
-            }
+        mods.setInstalled(row, folder.path);
+        mods.setHasUpdate(row, hasNewerVersion(mods.at(row), folder));
+        qCInfo(loggerCategory) << "Found installed mod:" << mods.title(row) << "at" << folder.path;
 
-        }
-        
+        numInstalled++;
     }
 
     qCInfo(loggerCategory) << "Scanned " << numInstalled << " installed mods.";
@@ -106,6 +237,57 @@ void Manager::scanInstalledMods() {
     emit installedModsChanged();
 }
 
+// Catalog entry an AddOns folder belongs to: the one titled like it, else the only one listing a
+// folder of that name. Libraries bundled by several mods stay unmatched
+int Manager::catalogRowForFolder(const QString& name) const {
+    const int row = mods.findTitle(name);
+    if (row >= 0) return row;
+
+    const QList<int> rows = mods.rowsWithFolder(name);
+    return rows.size() == 1 ? rows.first() : -1;
+}
+
+// Install state of one catalog row against the last scan, for entries a refresh added or revised.
+// Returns whether the row's installed or update state changed
+bool Manager::matchInstalledFolder(int row) {
+    const quint8 before = mods.flags(row) & (CatalogStore::Installed | CatalogStore::HasUpdate);
+
+    QStringList names = { mods.title(row) };
+    for (const Dependancies& addon : mods.at(row).addons) {
+        names.append(addon.path);
+    }
+
+    const InstalledFolder* folder = nullptr;
+    for (const QString& name : names) {
+        const auto it = m_installedFolders.constFind(name);
+        if (it != m_installedFolders.constEnd() && catalogRowForFolder(name) == row) {
+            folder = &it.value();
+            break;
+        }
+    }
+
+    if (!folder) {
+        mods.setInstalled(row, QString());
+    } else {
+        mods.setInstalled(row, folder->path);
+        mods.setHasUpdate(row, hasNewerVersion(mods.at(row), *folder));
+    }
+
+    return (mods.flags(row) & (CatalogStore::Installed | CatalogStore::HasUpdate)) != before;
+}
+
+// The catalog lists the AddOnVersion of each folder a mod ships; an installed folder behind it needs updating
+bool Manager::hasNewerVersion(const ModInfo& mod, const InstalledFolder& folder) const {
+    for (const Dependancies& addon : mod.addons) {
+        if (addon.path != folder.name) continue;
+
+        bool ok = false;
+        const int available = addon.addOnVersion.toInt(&ok);
+        return ok && folder.addOnVersion >= 0 && available > folder.addOnVersion;
+    }
+    return false;
+}
+
 ModInfo Manager::parseInstalledMod(const QDir& directory) {
     ModInfo mod;
     mod.isInstalled = true;
@@ -115,273 +297,709 @@ ModInfo Manager::parseInstalledMod(const QDir& directory) {
 }
 
 QList<ModInfo> Manager::getInstalledMods() const {
-    QList<ModInfo> result;
-    for (ModInfo* mod : installedMods.values()) {
-        if (!result.contains(*mod)) {
-            qCInfo(loggerCategory) << "getInstalledMods found installed mod:" << mod->title;
-            result.append(*mod);
-        }
-    }
+    const QList<ModInfo> result = mods.records(mods.rowsWith(CatalogStore::Installed));
     qCInfo(loggerCategory) << "getInstalledMods found " << result.size() << " installed mods";
     return result;
 }
 
-ModInfo* Manager::getInstalledMod(const QString& id) {
-    if (installedMods.contains(id)) {
-        return installedMods[id];
-    }
+// Installed entries are listed by id, or by title when the catalog entry has none
+int Manager::installedRow(const QString& id) const {
+    const int row = mods.findId(id, CatalogStore::Installed);
+    return row >= 0 ? row : mods.findTitle(id, CatalogStore::Installed);
+}
 
-    return nullptr;
+const ModInfo* Manager::getInstalledMod(const QString& id) const {
+    const int row = installedRow(id);
+    return row < 0 ? nullptr : &mods.at(row);
 }
 
 bool Manager::uninstallMod(const QString& id) {
-    ModInfo* mod = getInstalledMod(id);
-    if (!mod) {
+    const int row = installedRow(id);
+    if (row < 0) {
         return false;
     }
 
-    emit modActionStarted("uninstall", mod->title);
+    // The record is updated below, keep what is reported
+    const QString title = mods.at(row).title;
+    const QString installPath = mods.at(row).installPath;
 
-    QDir dir(mod->installPath);
+    emit modActionStarted("uninstall", title);
+
+    QDir dir(installPath);
 
     bool success = false;
     if (dir.exists()) {
         success = dir.removeRecursively();
         if (success) {
-            qCInfo(loggerCategory) << "Uninstalled mod:" << mod->title;
+            qCInfo(loggerCategory) << "Uninstalled mod:" << title;
 
-            mods.removeIf([id](const ModInfo& m) {
-                return m.isInstalled && (m.id == id || (id.isEmpty() && m.title == id));
-            });
+            mods.setInstalled(row, QString()); // Back to an available catalog entry
 
             emit installedModsChanged();
         } else {
-            qCWarning(loggerCategory) << "Failed to uninstall mod:" << mod->title;
+            qCWarning(loggerCategory) << "Failed to uninstall mod:" << title;
         }
     }
 
-    emit modActionCompleted("uninstall", mod->title, success);
+    emit modActionCompleted("uninstall", title, success);
     return success;
 }
 
 
 // Reads the manifest json file (master.json) for all ESOUI addons
 void Manager::parseAvailableMods(const QString& filePath) {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        qCWarning(loggerCategory) << "Failed to open master.json file:" << file.errorString();
-        //emit availableModsChanged();
-        return;
-    }
-    QByteArray jsonData = file.readAll();
-    file.close();
+    startCatalogLoad(filePath, false);
+}
 
-    QJsonParseError parseError;
-    QJsonDocument document = QJsonDocument::fromJson(jsonData, &parseError);
+// Decoding and the AddOns scan run as a background job; the GUI thread only takes the finished
+// catalog over by move. A newer load supersedes one still running, whose result is then dropped.
+// A parsed master.json is also written out as the snapshot the next launch starts from.
+// AddOns is only scanned for the first catalog, refreshes match against the last scan
+void Manager::startCatalogLoad(const QString& filePath, bool fromSnapshot) {
+    if (m_catalogCancel) {
+        m_catalogCancel->store(true);
+    }
+    const auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    m_catalogCancel = cancelled;
+    const quint64 generation = ++m_catalogGeneration;
+    const QString addonsPath = m_addonsDir.absolutePath();
+    const QString snapshotPath = getCatalogSnapshotPath();
+    const bool scanInstalled = !m_catalogLoaded;
+
+    auto* watcher = new QFutureWatcher<CatalogLoad>(this);
+    connect(watcher, &QFutureWatcher<CatalogLoad>::finished, this, [this, watcher, generation]() {
+        watcher->deleteLater();
+        if (generation != m_catalogGeneration) {
+            qCInfo(loggerCategory) << "Dropping superseded catalog load";
+            return;
+        }
+        m_catalogCancel.reset();
+        applyCatalog(watcher->future().takeResult());
+    });
+
+    watcher->setFuture(QtConcurrent::run(catalogPool(), [filePath, fromSnapshot, snapshotPath, addonsPath, scanInstalled, cancelled]() {
+        CatalogLoad load;
+        load.fromSnapshot = fromSnapshot;
+        if (fromSnapshot) {
+            load.ok = CatalogSnapshot::load(snapshotPath, &load.mods, &load.error);
+        } else {
+            // Taken before the file is opened: should master.json be replaced during the parse, the
+            // snapshot is stamped as the old file and the next check sees it out of date
+            const QFileInfo source(filePath);
+            const qint64 sourceSize = source.size();
+            const QDateTime sourceModified = source.lastModified();
+
+            CatalogParseOptions options;
+            options.cancelled = cancelled.get();
+            load.ok = CatalogParser::parseFileParallel(filePath, &load.mods, &load.error, options);
+            if (load.ok) {
+                CatalogSnapshot::save(snapshotPath, load.mods, sourceSize, sourceModified);
+            }
+        }
+        if (load.ok && scanInstalled) {
+            load.scanned = true;
+            if (QDir(addonsPath).exists()) {
+                load.installed = scanAddonsDir(addonsPath);
+            }
+        }
+        return load;
+    }));
+}
 
-    // Emit empty list if parsing fails
-    if (parseError.error != QJsonParseError::NoError) {
-        qCWarning(loggerCategory) << "Failed to parse master.json:" << parseError.errorString();
-        emit availableModsChanged();
+void Manager::applyCatalog(CatalogLoad load) {
+    // No usable snapshot is the normal first-run case. The local master.json, if any, is the
+    // next best thing while the fetch is in flight; the fetch may also have found it current
+    if (!load.ok && load.fromSnapshot) {
+        qCInfo(loggerCategory) << "No catalog snapshot loaded:" << load.error;
+        const QString masterJsonPath = m_pathing->getAppDataPath() + "/master.json";
+        if (QFile::exists(masterJsonPath)) {
+            parseAvailableMods(masterJsonPath);
+        }
         return;
     }
 
-    if (!document.isArray()) {
-        qCWarning(loggerCategory) << "master.json is not a valid JSON array";
+    // A malformed catalog is dropped as a whole rather than half applied
+    if (!load.ok) {
+        qCWarning(loggerCategory) << "Failed to parse master.json:" << load.error;
         emit availableModsChanged();
         return;
     }
 
-    QJsonArray modsJsonArray = document.array();
-
-    for (const QJsonValue& value : modsJsonArray) {
-        qCInfo(loggerCategory) << "Processing mod entry:" << value.toString();
-        QJsonObject modObj = value.toObject();
+    // Only what differs from the current catalog is applied, ids are taken before rows move
+    const CatalogDiff diff = mods.diff(load.mods);
+    QStringList added;
+    QStringList removed;
+    QStringList changed;
+    bool installedChanged = false;
+    for (int pos : diff.added) {
+        added.append(load.mods[pos].id);
+    }
+    for (int row : diff.removed) {
+        if (!mods.id(row).isEmpty()) removed.append(mods.id(row));
+        installedChanged |= mods.hasFlags(row, CatalogStore::Installed);
+    }
+    for (const QPair<int, int>& change : diff.changed) {
+        changed.append(load.mods[change.second].id);
+    }
+    mods.apply(diff, std::move(load.mods));
+    const bool firstLoad = !m_catalogLoaded;
+    m_catalogLoaded = true;
 
-        ModInfo mod = parseAvailableMod(modObj);
-        mods.append(mod);
+    if (load.scanned) {
+        applyInstalledScan(load.installed);
+    } else {
+        for (const QStringList* ids : { &added, &changed }) {
+            for (const QString& id : *ids) {
+                installedChanged |= matchInstalledFolder(mods.findId(id));
+            }
+        }
+        if (installedChanged) {
+            emit installedModsChanged();
+        }
     }
 
-    qCInfo(loggerCategory) << "Loaded" << getAvailableMods().size() << "available mods";
-    //updateModComparisons();
-    emit availableModsChanged();
+    qCInfo(loggerCategory) << "Loaded" << mods.size() << "catalog entries" << (load.fromSnapshot ? "from the snapshot," : "from master.json,")
+        << added.size() << "added," << removed.size() << "removed," << changed.size() << "changed";
+
+    if (!added.isEmpty()) emit catalogModsAdded(added);
+    if (!removed.isEmpty()) emit catalogModsRemoved(removed);
+    if (!changed.isEmpty()) emit catalogModsChanged(changed);
+    if (firstLoad || !diff.isEmpty()) {
+        emit availableModsChanged();
+    }
     emit availableModsLoaded();
 }
 
+// Stale-while-revalidate: the snapshot from the last run is shown right away, the revalidated
+// catalog replaces it once fetched and decoded
 void Manager::loadAvailableMods() {
     qCInfo(loggerCategory) << "Loading available mods";
 
+    if (!m_catalogLoaded && !m_catalogCancel) {
+        startCatalogLoad(QString(), true);
+    }
+
     QUrl masterUrl("https://api.mmoui.com/v4/game/ESO/filelist.json");
     QString masterJsonPath = m_pathing->getAppDataPath() + "/master.json";
 
-    httpClient->addDownload(masterUrl, masterJsonPath);
+    DownloadOptions options;
+    options.revalidate = true;
+    options.priority = DownloadPriority::Catalog;
+    httpClient->addDownload(masterUrl, masterJsonPath, options);
 }
 
-ModInfo Manager::parseAvailableMod(const QJsonObject& jsonData) {
-    ModInfo mod;
-    mod.isInstalled = false;
-
-    // Basic mod info
-    mod.id = jsonData["id"].toString();
-    mod.categoryId = jsonData["categoryId"].toString();
-    mod.version = jsonData["version"].toString();
-    mod.lastUpdate = jsonData["lastUpdate"].toString();
-    mod.title = jsonData["title"].toString();
-    mod.author = jsonData["author"].toString();
-    mod.fileInfoUri = jsonData["fileInfoUri"].toString();
-    mod.downloads = jsonData["downloads"].toInt();
-    mod.downloadsMonthly = jsonData["downloadsMonthly"].toInt();
-    mod.checksum = jsonData["checksum"].toString();
-    mod.library = jsonData["library"].toBool(false);
-    mod.donationUrl = jsonData.contains("donationUri") ? QUrl(jsonData["donationUri"].toString()) : QUrl();
-    mod.downloadUrl = QUrl(jsonData["downloadUri"].toString());
-
-    if (jsonData.contains("gameVersions") && jsonData["gameVersions"].isArray()) {
-        QJsonArray versionsArray = jsonData["gameVersions"].toArray();
-        QStringList versions;
-        for (const QJsonValue& version : versionsArray) {
-            versions.append(version.toString());
-        }
-        mod.gameVersions = versions;
+QList<ModInfo> Manager::getAvailableMods() const {
+    return mods.records(mods.rowsWith(0, CatalogStore::Installed));
+}
+
+QList<ModInfo> Manager::getModsWithUpdates() const {
+    return mods.records(mods.rowsWith(CatalogStore::Installed | CatalogStore::HasUpdate));
+}
+
+const ModInfo* Manager::getAvailableMod(const QString& id) const {
+    const int row = mods.findId(id, 0, CatalogStore::Installed);
+    return row < 0 ? nullptr : &mods.at(row);
+}
+
+bool Manager::installMod(const QString& id) {
+    const ModInfo* mod = getAvailableMod(id);
+    if (!mod || mod->downloadUrl.isEmpty()) {
+        qCWarning(loggerCategory) << "Attempted to install invalid mod:" << id;
+        return false;
+    }
+
+    return startInstall(*mod, "install", QString(), DownloadPriority::Interactive);
+}
+
+// Shared by install and update. The archive is extracted into a staging folder and only swapped
+// into AddOns once complete, so an update never leaves the addon missing
+bool Manager::startInstall(const ModInfo& mod, const QString& action, const QString& replacePath, DownloadPriority priority) {
+    // Archives are stored by checksum, so anything installed before can be reinstalled offline
+    const bool cacheable = ArchiveCache::isValidKey(mod.checksum);
+
+    QString downloadPath;
+    if (cacheable) {
+        downloadPath = m_archiveCache.pathFor(mod.checksum);
     } else {
-        mod.gameVersions = QStringList();
+        // The id keeps mods that share a title from downloading over each other
+        QString fileName = mod.title.isEmpty() ? mod.id : mod.title + "-" + mod.id;
+        fileName = fileName.replace(" ", "_").replace("/", "_");
+        downloadPath = m_pathing->getAppDataPath() + "/downloads/" + fileName + ".zip";
+
+        QDir downloadsDir(m_pathing->getAppDataPath() + "/downloads");
+        if (!downloadsDir.exists()) {
+            downloadsDir.mkpath(".");
+        }
     }
 
-    if (jsonData.contains("addons") && jsonData["addons"].isArray()) {
-        QJsonArray addonsArray = jsonData["addons"].toArray();
-        QList<Dependancies> addonsList;
+    // Asking again may be more urgent, e.g. Update clicked on a mod a batch queued in the background.
+    // The client folds the repeat into the queued or running download and only ever raises its priority.
+    // Past the download (or installing from the cache) there is nothing to raise
+    if (m_installing.contains(mod.id)) {
+        qCInfo(loggerCategory) << mod.title << "is already being installed";
+        if (m_pendingArchives.contains(downloadPath)) {
+            raisePendingDownload(m_pendingArchives[downloadPath].first(), priority);
+        }
+        return true;
+    }
 
-        for (const QJsonValue& addonValue : addonsArray) {
-            if (addonValue.isObject()) {
-                QJsonObject addonObj = addonValue.toObject();
-                Dependancies dependency;
-
-                dependency.path = addonObj["path"].toString();
-                dependency.addOnVersion = addonObj["addOnVersion"].toString();
-                dependency.apiVersion = addonObj["apiVersion"].toString();
-                dependency.library = addonObj.contains("library") ? addonObj["library"].toBool() : false;
-
-                // Parse optional and required dependencies if present
-                if (addonObj.contains("optionalDependencies") && addonObj["optionalDependencies"].isArray()) {
-                    QJsonArray optDepArray = addonObj["optionalDependencies"].toArray();
-                    for (const QJsonValue& depValue : optDepArray) {
-                        dependency.optionalDependencies.append(depValue.toString());
-                    }
-                }
+    emit modActionStarted(action, mod.title);
+
+    PendingArchive pending;
+    pending.modId = mod.id;
+    pending.modTitle = mod.title;
+    pending.downloadUrl = mod.downloadUrl;
+    pending.priority = priority;
+    pending.checksum = cacheable ? mod.checksum : QString();
+    pending.action = action;
+    pending.archivePath = downloadPath;
+    pending.replacePath = replacePath;
+    pending.delta = !replacePath.isEmpty();
+
+    // Queued extractions read the cached archive later, it must survive evictions until then
+    if (!pending.checksum.isEmpty()) {
+        m_archiveCache.pin(pending.checksum);
+    }
 
-                if (addonObj.contains("requiredDependencies") && addonObj["requiredDependencies"].isArray()) {
-                    QJsonArray reqDepArray = addonObj["requiredDependencies"].toArray();
-                    for (const QJsonValue& depValue : reqDepArray) {
-                        dependency.requiredDependencies.append(depValue.toString());
-                    }
-                }
+    if (cacheable && m_archiveCache.contains(mod.checksum)) {
+        qCInfo(loggerCategory) << "Installing" << mod.title << "from cached archive";
+        m_archiveCache.touch(mod.checksum);
+        m_installing.insert(mod.id, nullptr);
+        extractArchive(pending);
+        return true;
+    }
 
-                addonsList.append(dependency);
-            }
+    // Another mod ships the same archive and is already fetching it. Only one extractor can be fed
+    // from the transfer, so this one extracts the finished file
+    if (m_pendingArchives.contains(downloadPath)) {
+        qCInfo(loggerCategory) << "Waiting for" << mod.title << "archive, already downloading for another mod";
+        m_installing.insert(mod.id, nullptr);
+        m_pendingArchives[downloadPath].append(pending);
+        raisePendingDownload(m_pendingArchives[downloadPath].first(), priority);
+        return true;
+    }
+
+    // Fresh installs are extracted while they download. Updates need the full entry list to compare
+    // against the installed files, so they wait for the archive and go through extractArchive()
+    if (!pending.delta) {
+        pending.extractor = std::make_shared<ArchiveExtractor>(newStagingPath(mod.id));
+        pending.streamed = true;
+    }
+    m_installing.insert(mod.id, pending.extractor);
+    m_pendingArchives.insert(downloadPath, { pending });
+
+    DownloadOptions options;
+    options.priority = priority;
+    options.expectedChecksum = pending.checksum.toLatin1();
+    options.sink = pending.extractor;
+    httpClient->addDownload(mod.downloadUrl, downloadPath, options);
+
+    // The download and installation completion will be handled in the httpClient signal handlers
+    return true;
+}
+
+// Asks again for the download a pending archive leads, with its own URL and options, so the client
+// folds it into the transfer queued or in flight and raises its priority. Asking at the same or a
+// lower priority changes nothing and is skipped
+void Manager::raisePendingDownload(PendingArchive& lead, DownloadPriority priority) {
+    if (priority >= lead.priority) return;
+    lead.priority = priority;
+
+    DownloadOptions options;
+    options.priority = priority;
+    options.expectedChecksum = lead.checksum.toLatin1();
+    options.sink = lead.extractor;
+    httpClient->addDownload(lead.downloadUrl, lead.archivePath, options);
+}
+
+// Archives on disk are extracted through their central directory, in parallel. Only a few run at
+// once, the rest wait their turn so a large batch does not pile up blocked workers
+void Manager::extractArchive(PendingArchive pending) {
+    if (m_activeExtractions >= MAX_CONCURRENT_EXTRACTIONS) {
+        m_extractionQueue.enqueue(pending);
+        return;
+    }
+    m_activeExtractions++;
+
+    pending.extractor = std::make_shared<ArchiveExtractor>(newStagingPath(pending.modId));
+    pending.streamed = false;
+    m_installing.insert(pending.modId, pending.extractor);
+
+    if (pending.delta) {
+        pending.extractor->setDeltaBase(m_addonsDir.absolutePath());
+    }
+    pending.extractor->extractFile(pending.archivePath);
+    pending.extractor->finish(this, [this, pending](const ArchiveExtractor::Result& result) {
+        m_activeExtractions--;
+        finishInstall(pending, result);
+
+        while (m_activeExtractions < MAX_CONCURRENT_EXTRACTIONS && !m_extractionQueue.isEmpty()) {
+            extractArchive(m_extractionQueue.dequeue());
         }
+    });
+}
 
-        mod.addons = addonsList;
-    } else {
-        mod.addons = QList<Dependancies>();
+QString Manager::stagingRoot() const {
+    return QDir::cleanPath(m_pathing->getAddonsPath() + "/../.esomm-staging");
+}
+
+// Leftovers of installs interrupted by a crash or shutdown. A commit journal that never got its
+// committed flag is replayed backwards, which puts the previous version back exactly as an
+// in-process rollback would; a committed one only has its leftovers discarded. Staging folders
+// hold nothing else worth keeping. A ".previous" folder without a journal predates journaling and
+// is left alone if it still holds files
+void Manager::recoverStaging() {
+    const QDir root(stagingRoot());
+    QSet<QString> journaled;
+    QSet<QString> kept; // Journals that could not be replayed, tried again next launch
+
+    for (const QFileInfo& journal : root.entryInfoList({ "*.journal" }, QDir::Files | QDir::Hidden)) {
+        const QString stagingPath = root.absoluteFilePath(journal.completeBaseName());
+        journaled.insert(stagingPath);
+
+        QList<CommitMove> moves;
+        bool committed = false;
+        if (!readCommitJournal(journal.absoluteFilePath(), &moves, &committed)) {
+            qCWarning(loggerCategory) << "Unreadable commit journal, leaving" << stagingPath << "untouched";
+            kept.insert(stagingPath);
+            continue;
+        }
+        if (!committed) {
+            if (!undoMoves(moves)) {
+                qCWarning(loggerCategory) << "Failed to roll back an interrupted install, previous copy left at" << stagingPath + ".previous";
+                kept.insert(stagingPath);
+                continue;
+            }
+            qCInfo(loggerCategory) << "Rolled back an interrupted install," << moves.size() << "moves undone";
+        }
+        QFile::remove(journal.absoluteFilePath());
     }
 
-    // Handle the date format
-    QString lastUpdateStr = jsonData["lastUpdate"].toString();
-    if (!lastUpdateStr.isEmpty()) {
-        mod.lastUpdated = QDateTime::fromString(lastUpdateStr, Qt::ISODate);
-        if (!mod.lastUpdated.isValid()) {
-            mod.lastUpdated = QDateTime::fromString(lastUpdateStr, "yyyy-MM-dd");
+    for (const QFileInfo& leftover : root.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden)) {
+        const bool previous = leftover.fileName().endsWith(".previous");
+        QString stagingPath = leftover.absoluteFilePath();
+        if (previous) stagingPath.chop(int(qstrlen(".previous")));
+        if (kept.contains(stagingPath)) continue;
+
+        if (previous && !journaled.contains(stagingPath)
+            && QDirIterator(leftover.absoluteFilePath(), QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories).hasNext()) {
+            qCWarning(loggerCategory) << "Keeping" << leftover.absoluteFilePath() << "- previous addon files without a commit journal";
+            continue;
         }
+        QDir(leftover.absoluteFilePath()).removeRecursively();
     }
+}
 
-    return mod;
+// Each extraction gets its own folder next to AddOns, so committing it is a rename
+QString Manager::newStagingPath(const QString& modId) const {
+    return QString("%1/%2-%3").arg(stagingRoot(), modId)
+        .arg(QRandomGenerator::global()->generate(), 8, 16, QChar('0'));
 }
 
-QList<ModInfo> Manager::getAvailableMods() const {
-    QList<ModInfo> result;
-    for (const ModInfo& mod : mods) {
-        if (!mod.isInstalled) {
-            result.append(mod);
+void Manager::finishInstall(const PendingArchive& pending, const ArchiveExtractor::Result& result) {
+    // Some archives cannot be streamed (e.g. stored entries sized only by a trailing descriptor);
+    // the finished download can still be read through its central directory
+    if (!result.success && pending.streamed && QFileInfo::exists(pending.archivePath)) {
+        qCInfo(loggerCategory) << "Streaming extraction of" << pending.modTitle << "failed, extracting the archive instead";
+        extractArchive(pending);
+        return;
+    }
+
+    bool success = result.success;
+    for (const QString& entry : result.topLevelEntries) {
+        if (!ArchiveExtractor::isPlainSegment(entry)) {
+            qCWarning(loggerCategory) << "Refusing to install" << pending.modTitle << "- unsafe top-level entry" << entry;
+            QDir(result.stagingPath).removeRecursively();
+            success = false;
+            break;
+        }
+    }
+
+    // The new version no longer ships the folder the old one was installed in. It is moved out as
+    // part of the commit, so a failure or crash puts it back along with everything else
+    QString retiredPath;
+    const QString replaced = QFileInfo(pending.replacePath).fileName();
+    if (!replaced.isEmpty() && !result.topLevelEntries.contains(replaced, Qt::CaseInsensitive)
+        && QFileInfo(pending.replacePath).isDir()) {
+        retiredPath = pending.replacePath;
+    }
+    success = success && (result.delta ? commitDelta(result, retiredPath) : commitStaged(result, retiredPath));
+
+    if (success) {
+        if (result.delta) {
+            qCInfo(loggerCategory) << "Updated" << pending.modTitle << "-" << result.changedFiles.size() << "files written,"
+                << result.removedFiles.size() << "removed," << result.unchangedFiles << "unchanged;"
+                << result.bytesSkipped << "of" << (result.bytesSkipped + result.bytesWritten) << "bytes not rewritten";
+            emit deltaUpdateApplied(pending.modTitle, int(result.changedFiles.size()), int(result.removedFiles.size()),
+                result.bytesWritten, result.bytesSkipped);
+        } else {
+            qCInfo(loggerCategory) << "Installed" << pending.modTitle << "-" << result.files << "files,"
+                << result.bytesWritten << "bytes into" << result.topLevelEntries;
+        }
+    } else {
+        qCWarning(loggerCategory) << "Failed to" << pending.action << pending.modTitle << "-" << result.error;
+    }
+    m_installing.remove(pending.modId);
+    if (!pending.checksum.isEmpty()) {
+        m_archiveCache.unpin(pending.checksum);
+        // A damaged archive would fail every install from the cache, fetch it again next time. Disk
+        // errors in staging or the live folder say nothing about the archive, so it stays
+        if (!result.success && result.corrupt && !pending.streamed) {
+            qCWarning(loggerCategory) << "Dropping corrupt cached archive" << pending.archivePath;
+            m_archiveCache.remove(pending.checksum);
+        }
+    }
+    emit modActionCompleted(pending.action, pending.modTitle, success);
+
+    if (m_updateBatch.pending.remove(pending.modId)) {
+        (success ? m_updateBatch.updated : m_updateBatch.failed).append(pending.modTitle);
+        if (m_updateBatch.pending.isEmpty()) {
+            finishUpdateBatch();
         }
     }
-    return result;
 }
 
-QList<ModInfo> Manager::getModsWithUpdates() const {
-    QList<ModInfo> result;
-    for (const ModInfo& mod : mods) {
-        if (mod.isInstalled && mod.hasUpdate) {
-            result.append(mod);
+// Swaps the extracted top-level folders into AddOns. Folders they replace are first moved aside
+// into a sibling of the staging folder, so if any step fails the previous version is put back.
+// Loose files at the archive root (readmes and the like) stay behind: in the AddOns root they
+// would replace files that belong to nobody or to another mod. retiredPath, if set, is an installed
+// folder the new version drops; it goes aside with the replaced ones
+bool Manager::commitStaged(const ArchiveExtractor::Result& result, const QString& retiredPath) {
+    const QDir staging(result.stagingPath);
+    const QDir previous(result.stagingPath + ".previous");
+
+    QList<CommitMove> moves;
+    for (const QString& entry : result.topLevelEntries) {
+        if (!QFileInfo(staging.absoluteFilePath(entry)).isDir()) {
+            qCWarning(loggerCategory) << "Not installing" << entry << "- files outside an addon folder are skipped";
+            continue;
         }
+        const QString target = m_addonsDir.absoluteFilePath(entry);
+        if (QFileInfo::exists(target)) {
+            moves.append({ target, previous.absoluteFilePath(entry) });
+        }
+        moves.append({ staging.absoluteFilePath(entry), target });
     }
-    return result;
+    if (moves.isEmpty()) {
+        staging.removeRecursively();
+        return false;
+    }
+    if (!retiredPath.isEmpty()) {
+        moves.append({ retiredPath, previous.absoluteFilePath(QFileInfo(retiredPath).fileName()) });
+    }
+    return applyMoves(result.stagingPath, "staged", moves);
 }
 
-ModInfo* Manager::getAvailableMod(const QString& id) {
-    for (auto& mod : mods) {
-        if (!mod.isInstalled && mod.id == id) {
-            return &mod;
+// Applies a delta extraction file by file: changed files replace their live copies and removed ones
+// are moved out, both through the same journaled moves as a full install
+bool Manager::commitDelta(const ArchiveExtractor::Result& result, const QString& retiredPath) {
+    if (result.topLevelEntries.isEmpty()) {
+        QDir(result.stagingPath).removeRecursively();
+        return false; // An empty archive would read as every installed file removed
+    }
+
+    const QDir staging(result.stagingPath);
+    const QDir previous(result.stagingPath + ".previous");
+
+    QList<CommitMove> moves;
+    for (const QString& file : result.changedFiles) {
+        if (!file.contains('/')) {
+            qCWarning(loggerCategory) << "Not installing" << file << "- files outside an addon folder are skipped";
+            continue;
         }
+        const QString live = m_addonsDir.absoluteFilePath(file);
+        if (QFileInfo::exists(live)) {
+            moves.append({ live, previous.absoluteFilePath(file) });
+        }
+        moves.append({ staging.absoluteFilePath(file), live });
+    }
+    for (const QString& file : result.removedFiles) {
+        if (!file.contains('/')) continue;
+        moves.append({ m_addonsDir.absoluteFilePath(file), previous.absoluteFilePath(file) });
+    }
+    if (!retiredPath.isEmpty()) {
+        moves.append({ retiredPath, previous.absoluteFilePath(QFileInfo(retiredPath).fileName()) });
+    }
+
+    if (!applyMoves(result.stagingPath, "delta", moves)) {
+        return false;
+    }
+    for (const QString& file : result.removedFiles) {
+        m_addonsDir.rmpath(QFileInfo(file).path()); // Only folders the removal left empty
     }
-    return nullptr;
+    return true;
 }
 
-bool Manager::installMod(const QString& id) {
-    ModInfo* mod = getAvailableMod(id);
-    if (!mod || mod->downloadUrl.isEmpty()) {
-        qCWarning(loggerCategory) << "Attempted to install invalid mod:" << id;
+// Runs a commit's renames in order. The full list is journaled before the first one and flagged
+// committed after the last, so a crash in between is rolled back at the next launch (see
+// recoverStaging). A failed rename undoes the ones before it, newest first. Staging and AddOns
+// share a volume, each move is a rename
+bool Manager::applyMoves(const QString& stagingPath, const QString& kind, const QList<CommitMove>& moves) {
+    const QString previousPath = stagingPath + ".previous";
+
+    if (!writeCommitJournal(stagingPath, kind, moves, false)) {
+        QDir(stagingPath).removeRecursively();
         return false;
     }
 
-    emit modActionStarted("install", mod->title);
+    qsizetype done = 0;
+    for (; done < moves.size(); done++) {
+        const CommitMove& move = moves[done];
+        QDir().mkpath(QFileInfo(move.to).absolutePath());
+        if (!QDir().rename(move.from, move.to)) {
+            qCWarning(loggerCategory) << "Failed to move" << move.from << "to" << move.to;
+            break;
+        }
+    }
+
+    const bool success = done == moves.size();
+    if (success) {
+        // Should this fail, a crash before the cleanup below rolls back a finished install: still consistent
+        writeCommitJournal(stagingPath, kind, moves, true);
+    } else if (!undoMoves(moves.mid(0, done))) {
+        qCWarning(loggerCategory) << "Failed to restore the previous version, the next launch retries from" << commitJournalPath(stagingPath);
+        return false;
+    }
 
-    QString fileName = mod->title.isEmpty() ? id : mod->title;
-    fileName = fileName.replace(" ", "_").replace("/", "_");
-    QString downloadPath = m_pathing->getAppDataPath() + "/downloads/" + fileName + ".zip";
+    QDir(previousPath).removeRecursively();
+    QDir(stagingPath).removeRecursively();
+    QFile::remove(commitJournalPath(stagingPath));
+    return success;
+}
 
-    QDir downloadsDir(m_pathing->getAppDataPath() + "/downloads");
-    if (!downloadsDir.exists()) {
-        downloadsDir.mkpath(".");
+QString Manager::commitJournalPath(const QString& stagingPath) {
+    return stagingPath + ".journal";
+}
+
+bool Manager::writeCommitJournal(const QString& stagingPath, const QString& kind, const QList<CommitMove>& moves, bool committed) {
+    QJsonArray entries;
+    for (const CommitMove& move : moves) {
+        entries.append(QJsonArray{ move.from, move.to });
+    }
+    QJsonObject journal;
+    journal["kind"] = kind;
+    journal["committed"] = committed;
+    journal["moves"] = entries;
+
+    QSaveFile file(commitJournalPath(stagingPath));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(loggerCategory) << "Failed to write commit journal:" << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(journal).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        qCWarning(loggerCategory) << "Failed to write commit journal:" << file.errorString();
+        return false;
     }
+    return true;
+}
 
-    httpClient->addDownload(mod->downloadUrl, downloadPath);
+bool Manager::readCommitJournal(const QString& path, QList<CommitMove>* moves, bool* committed) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
 
-    // The download and installation completion will be handled in the httpClient signal handlers
+    const QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+    if (!doc.isObject() || !doc.object()["moves"].isArray()) return false;
+
+    *committed = doc.object()["committed"].toBool();
+    for (const QJsonValue& value : doc.object()["moves"].toArray()) {
+        const QJsonArray move = value.toArray();
+        if (move.size() != 2 || !move[0].isString() || !move[1].isString()) return false;
+        moves->append({ move[0].toString(), move[1].toString() });
+    }
     return true;
 }
 
+// Newest first, so by the time a move is undone every later one is, and its source is free again
+// if it ever happened. A move whose source is still there, or whose destination is gone, never
+// happened or was already undone
+bool Manager::undoMoves(const QList<CommitMove>& moves) {
+    bool success = true;
+    for (auto it = moves.crbegin(); it != moves.crend(); ++it) {
+        if (QFileInfo::exists(it->from) || !QFileInfo::exists(it->to)) continue;
+
+        QDir().mkpath(QFileInfo(it->from).absolutePath());
+        if (!QDir().rename(it->to, it->from)) {
+            qCWarning(loggerCategory) << "Failed to restore" << it->from << "- copy left at" << it->to;
+            success = false;
+        }
+    }
+    return success;
+}
+
+void Manager::setArchiveCacheLimit(qint64 maxBytes) {
+    m_archiveCache.setMaxBytes(maxBytes);
+}
+
 bool Manager::updateMod(const QString& id) {
-    ModInfo* mod = getInstalledMod(id);
+    const ModInfo* mod = getInstalledMod(id);
     if (!mod || !mod->hasUpdate) {
         qCWarning(loggerCategory) << "Attempted to update invalid mod:" << id;
         return false;
     }
 
-    emit modActionStarted("update", mod->title);
-
-    ModInfo* availableMod = nullptr;
-    for (auto& m : mods) {
-        if (!m.isInstalled && m.id == mod->id) {
-            availableMod = &m;
-            break;
-        }
-    }
-
-    if (!availableMod || availableMod->downloadUrl.isEmpty()) {
+    if (mod->downloadUrl.isEmpty()) {
         qCWarning(loggerCategory) << "Could not find available version for update:" << id;
         emit modActionCompleted("update", mod->title, false);
         return false;
     }
 
-    // First uninstall the current version
-    if (!uninstallMod(id)) {
-        qCWarning(loggerCategory) << "Failed to uninstall mod for update:" << id;
-        emit modActionCompleted("update", mod->title, false);
-        return false;
+    // The installed version stays in place until the new one is extracted and swapped in
+    return startInstall(*mod, "update", mod->installPath, DownloadPriority::Interactive);
+}
+
+// Updates run side by side: downloads share the client's slots at background priority and
+// extraction is bounded by MAX_CONCURRENT_EXTRACTIONS. Each mod still reports modActionCompleted,
+// but the installed list is rescanned once, when the last one is committed.
+int Manager::updateMods(const QStringList& ids) {
+    const QSet<QString> wanted(ids.begin(), ids.end());
+    int started = 0;
+
+    for (int row : mods.rowsWith(CatalogStore::Installed | CatalogStore::HasUpdate)) {
+        if (!wanted.contains(mods.id(row)) || m_updateBatch.pending.contains(mods.id(row))) continue;
+
+        const ModInfo& mod = mods.at(row);
+        if (mod.downloadUrl.isEmpty()) continue;
+
+        m_updateBatch.pending.insert(mod.id);
+        if (startInstall(mod, "update", mod.installPath, DownloadPriority::Background)) {
+            started++;
+        } else {
+            m_updateBatch.pending.remove(mod.id);
+        }
+    }
+
+    qCInfo(loggerCategory) << "Updating" << started << "mods," << m_updateBatch.pending.size() << "in the batch";
+    return started;
+}
+
+int Manager::updateAllMods() {
+    QStringList ids;
+    for (const ModInfo& mod : getModsWithUpdates()) {
+        ids.append(mod.id);
     }
+    return updateMods(ids);
+}
 
-    // Then install the new version
-    return installMod(availableMod->id);
+bool Manager::isUpdatingBatch() const {
+    return !m_updateBatch.pending.isEmpty();
+}
+
+void Manager::finishUpdateBatch() {
+    const UpdateBatch batch = std::exchange(m_updateBatch, UpdateBatch());
+    qCInfo(loggerCategory) << "Batch update finished:" << batch.updated.size() << "updated," << batch.failed.size() << "failed";
+
+    scanInstalledMods(); // One reconciliation for the whole batch
+    emit modsUpdated(batch.updated, batch.failed);
+}
+
+QString Manager::getCatalogSnapshotPath() const {
+    return m_pathing->getAppDataPath() + "/catalog.snapshot";
+}
+
+// Whether the catalog shown, or the one being loaded, was decoded from this master.json
+bool Manager::isCatalogCurrent(const QString& masterJsonPath) const {
+    return (m_catalogLoaded || m_catalogCancel) && CatalogSnapshot::isBuiltFrom(getCatalogSnapshotPath(), QFileInfo(masterJsonPath));
 }
 
 QString Manager::getInstalledCachePath() const {
@@ -395,10 +1013,9 @@ void Manager::saveInstalledModsCache() {
     }
 
     QJsonArray installedArray;
-    for (ModInfo* mod : installedMods.values()) {
-        if (mod) {
-            installedArray.append(modToJson(*mod));
-        }
+    const QList<int> installedRows = mods.rowsWith(CatalogStore::Installed);
+    for (int row : installedRows) {
+        installedArray.append(modToJson(mods.at(row)));
     }
 
     QJsonDocument installedDoc(installedArray);
@@ -406,7 +1023,7 @@ void Manager::saveInstalledModsCache() {
     if (installedFile.open(QIODevice::WriteOnly)) {
         installedFile.write(installedDoc.toJson());
         installedFile.close();
-        qCInfo(loggerCategory) << "Saved " << installedMods.size() << " installed mods to cache.";
+        qCInfo(loggerCategory) << "Saved " << installedRows.size() << " installed mods to cache.";
     } else {
         qCWarning(loggerCategory) << "Failed to save installed mods cache:" << installedFile.errorString();
     }
@@ -429,16 +1046,15 @@ void Manager::loadInstalledModsCache() {
         return;
     }
 
+    // Stands in for the installed list until the first catalog load replaces it
     QJsonArray installedArray = doc.array();
-    installedMods.clear();
-    installedMods.reserve(installedArray.size());
-
     for (const QJsonValue& value : installedArray) {
         ModInfo mod = jsonToMod(value.toObject());
-        installedMods[mod.title] = &mod;
+        mod.isInstalled = true;
+        mods.append(std::move(mod));
     }
 
-    qCInfo(loggerCategory) << "Loaded" << installedMods.size() << "installed mods from cache.";
+    qCInfo(loggerCategory) << "Loaded" << installedArray.size() << "installed mods from cache.";
     emit installedModsChanged();
 }
 
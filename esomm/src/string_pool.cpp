@@ -0,0 +1,33 @@
+#include "string_pool.h"
+
+QString StringPool::intern(const char* utf8, qsizetype size) {
+    m_lookups.fetch_add(1, std::memory_order_relaxed);
+
+    // The probe key points into the caller's buffer, only a miss copies it
+    const QByteArray key = QByteArray::fromRawData(utf8, size);
+    Shard& shard = m_shards[qHash(key) % STRING_POOL_SHARDS];
+
+    QMutexLocker locker(&shard.mutex);
+    const auto it = shard.strings.constFind(key);
+    if (it != shard.strings.constEnd()) {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        m_bytesSaved.fetch_add(it.value().size() * qint64(sizeof(QChar)), std::memory_order_relaxed);
+        return it.value();
+    }
+
+    const QString value = QString::fromUtf8(utf8, size);
+    shard.strings.insert(QByteArray(utf8, size), value);
+    return value;
+}
+
+StringPool::Stats StringPool::stats() const {
+    Stats stats;
+    stats.lookups = m_lookups.load(std::memory_order_relaxed);
+    stats.hits = m_hits.load(std::memory_order_relaxed);
+    stats.bytesSaved = m_bytesSaved.load(std::memory_order_relaxed);
+    for (const Shard& shard : m_shards) {
+        QMutexLocker locker(&shard.mutex);
+        stats.distinct += shard.strings.size();
+    }
+    return stats;
+}